@@ -0,0 +1,456 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+
+/*
+    BLOCK BUFFER CACHE
+    one block = one page from page_alloc(), allocated on first use.
+
+    - lookup:     hash of (dev, blockno), BCACHE_BUCKETS chains
+    - eviction:   LRU list, the tail is the least recently released
+    - write-back: bdirty() only marks a buffer, a flusher process
+                  writes dirty blocks out in one batch once there are
+                  too many or the oldest has waited BCACHE_FLUSH_MS.
+                  the age is checked on brelse() and by a periodic
+                  timer callback, so an idle system flushes too
+    - read-ahead: after RA_TRIGGER sequential reads the following
+                  blocks are fetched asynchronously, the window doubles
+                  while it keeps hitting and resets on a seek
+
+    a buffer returned by bread() is locked by the caller until brelse().
+    buf->io is set while the device owns the page (read-ahead, flush).
+*/
+
+#define BCACHE_BUCKETS 31
+#define BCACHE_DIRTY_HIGH (NBUF / 2)     // flush when this many are dirty
+#define BCACHE_FLUSH_MS 1000             // or when the oldest is this old
+#define RA_TRIGGER 2                     // sequential reads before read-ahead
+#define RA_MIN 2                         // first read-ahead window, blocks
+#define RA_MAX 8
+
+static Buf bufs[NBUF];
+static Buf* buckets[BCACHE_BUCKETS];
+static Buf* lru_head;                    // most recently used
+static Buf* lru_tail;                    // eviction candidate
+
+static struct {
+    uint32_t last;                       // last block read
+    int streak;                          // sequential reads in a row
+    int window;                          // current read-ahead window
+    uint32_t ra_next;                    // first block not yet read ahead
+} ra_state;
+
+static WaitQueue flush_wait;             // the flusher, until flush_wanted
+static volatile int flush_wanted;
+static Mutex flush_lock;
+static int ndirty;
+static uint64_t oldest_dirty;            // mtime of the first dirty block
+
+static struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t ra_issued;
+    uint32_t ra_hits;
+    uint32_t evictions;
+    uint32_t flushes;
+    uint32_t flushed_blocks;
+    uint32_t flush_last_us;
+    uint32_t flush_max_us;
+} stat;
+
+static uint32_t bhash(int dev, uint32_t blockno)
+{
+    return (blockno ^ (dev << 24)) % BCACHE_BUCKETS;
+}
+
+static void hash_remove(Buf* b)
+{
+    Buf** pp = &buckets[bhash(b->dev, b->blockno)];
+    while (*pp) {
+        if (*pp == b) {
+            *pp = b->hash_next;
+            break;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    b->hash_next = NULL;
+}
+
+static void hash_insert(Buf* b)
+{
+    Buf** head = &buckets[bhash(b->dev, b->blockno)];
+    b->hash_next = *head;
+    *head = b;
+}
+
+static void lru_unlink(Buf* b)
+{
+    if (b->prev) b->prev->next = b->next; else lru_head = b->next;
+    if (b->next) b->next->prev = b->prev; else lru_tail = b->prev;
+    b->prev = b->next = NULL;
+}
+
+static void lru_push_front(Buf* b)
+{
+    b->prev = NULL;
+    b->next = lru_head;
+    if (lru_head) lru_head->prev = b; else lru_tail = b;
+    lru_head = b;
+}
+
+static Buf* bcache_lookup(int dev, uint32_t blockno)
+{
+    for (Buf* b = buckets[bhash(dev, blockno)]; b; b = b->hash_next) {
+        if (b->dev == dev && b->blockno == blockno) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+// runs in interrupt context when a read-ahead or flush finishes
+static void bcache_io_done(BlkRequest* req)
+{
+    Buf* b = req->priv;
+    if (!req->write) {
+        b->valid = (req->status == 0);
+    }
+    b->io = 0;
+    wait_queue_wake_all(&b->io_wait);
+}
+
+static int bcache_submit(Buf* b, int write)
+{
+    if (b->dev != 0) {
+        return -1;               // only the virtio disk so far
+    }
+    b->req.sector = (uint64_t)b->blockno * (BLOCK_SIZE / BLK_SECTOR_SIZE);
+    b->req.write = write;
+    b->req.nseg = 1;
+    b->req.seg[0].buf = b->data;
+    b->req.seg[0].len = BLOCK_SIZE;
+    b->req.complete = bcache_io_done;
+    b->req.priv = b;
+
+    b->io = 1;
+    if (virtio_blk_submit(&b->req) < 0) {
+        b->io = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static void bcache_wait_io(Buf* b)
+{
+    reg intr = intr_off();
+    while (b->io) {
+        if (current_process()) {
+            wait_queue_sleep(&b->io_wait);
+        } else {
+            virtio_blk_wait(&b->req);   // boot time: let the driver poll
+        }
+    }
+    intr_restore(intr);
+}
+
+// pick an unused clean buffer from the LRU end, or NULL.
+// with allow_dirty, a dirty one is written back first (may sleep).
+static Buf* bcache_victim(int allow_dirty)
+{
+    for (Buf* b = lru_tail; b; b = b->prev) {
+        if (b->refcnt == 0 && !b->io && !b->dirty) {
+            return b;
+        }
+    }
+    if (!allow_dirty) {
+        return NULL;
+    }
+    for (Buf* b = lru_tail; b; b = b->prev) {
+        if (b->refcnt == 0 && !b->io) {
+            b->refcnt++;              // keep it while we sleep on the write
+            b->dirty = 0;
+            ndirty--;
+            if (bcache_submit(b, 1) == 0) {
+                bcache_wait_io(b);
+            } else {
+                b->dirty = 1;
+                ndirty++;
+            }
+            b->refcnt--;
+            return NULL;              // the world may have changed, retry
+        }
+    }
+    return NULL;
+}
+
+// move victim b over to (dev, blockno), contents not valid yet
+static int bcache_recycle(Buf* b, int dev, uint32_t blockno)
+{
+    if (!b->data) {
+        b->data = page_alloc(1);
+        if (!b->data) {
+            return -1;
+        }
+    }
+    if (b->dev >= 0) {
+        hash_remove(b);
+        stat.evictions++;
+    }
+    b->dev = dev;
+    b->blockno = blockno;
+    b->valid = 0;
+    hash_insert(b);
+    return 0;
+}
+
+// find or claim the buffer of (dev, blockno), returns it referenced
+static Buf* bget(int dev, uint32_t blockno)
+{
+    while (1) {
+        Buf* b = bcache_lookup(dev, blockno);
+        if (b) {
+            b->refcnt++;
+            return b;
+        }
+
+        int dirty_left = ndirty;
+        b = bcache_victim(1);
+        if (b) {
+            if (bcache_recycle(b, dev, blockno) < 0) {
+                return NULL;
+            }
+            b->refcnt++;
+            return b;
+        }
+        if (dirty_left == ndirty) {
+            mini_printf("bcache: all buffers busy\n");
+            return NULL;
+        }
+    }
+}
+
+// start reading blocks ahead of a sequential reader
+static void bcache_readahead(int dev, uint32_t blockno)
+{
+    if (blockno == ra_state.last + 1) {
+        ra_state.streak++;
+    } else if (blockno != ra_state.last) {
+        ra_state.streak = 0;
+        ra_state.window = 0;
+        ra_state.ra_next = 0;
+    }
+    ra_state.last = blockno;
+    if (ra_state.streak < RA_TRIGGER) {
+        return;
+    }
+
+    if (ra_state.window == 0) {
+        ra_state.window = RA_MIN;
+    }
+    if (ra_state.ra_next <= blockno) {
+        ra_state.ra_next = blockno + 1;
+    }
+
+    uint32_t nblocks = (uint32_t)virtio_blk_capacity() / (BLOCK_SIZE / BLK_SECTOR_SIZE);
+    uint32_t end = blockno + ra_state.window;
+    while (ra_state.ra_next <= end && ra_state.ra_next < nblocks) {
+        uint32_t n = ra_state.ra_next;
+        if (!bcache_lookup(dev, n)) {
+            Buf* b = bcache_victim(0);   // never write back for a guess
+            if (!b || bcache_recycle(b, dev, n) < 0) {
+                return;
+            }
+            lru_unlink(b);
+            lru_push_front(b);
+            b->readahead = 1;
+            if (bcache_submit(b, 0) < 0) {
+                return;
+            }
+            stat.ra_issued++;
+        }
+        ra_state.ra_next++;
+    }
+}
+
+Buf* bread(int dev, uint32_t blockno)
+{
+    Buf* b = bget(dev, blockno);
+    if (!b) {
+        return NULL;
+    }
+    mutex_lock(&b->lock);
+    bcache_wait_io(b);
+
+    if (b->valid) {
+        stat.hits++;
+        if (b->readahead) {
+            stat.ra_hits++;
+            // the guess paid off: look further ahead next time
+            if (ra_state.window < RA_MAX) {
+                ra_state.window *= 2;
+            }
+        }
+    } else {
+        stat.misses++;
+        if (bcache_submit(b, 0) == 0) {
+            bcache_wait_io(b);
+        }
+        if (!b->valid) {
+            mutex_unlock(&b->lock);
+            b->refcnt--;
+            return NULL;
+        }
+    }
+    b->readahead = 0;
+
+    bcache_readahead(dev, blockno);
+    return b;
+}
+
+// the caller changed b->data, it reaches the disk on the next flush
+void bdirty(Buf* b)
+{
+    if (!b->dirty) {
+        if (ndirty == 0) {
+            oldest_dirty = read_mtime();
+        }
+        b->dirty = 1;
+        ndirty++;
+    }
+}
+
+// write b now instead of waiting for the flusher
+int bwrite(Buf* b)
+{
+    if (b->dirty) {
+        b->dirty = 0;
+        ndirty--;
+    }
+    if (bcache_submit(b, 1) < 0) {
+        return -1;
+    }
+    bcache_wait_io(b);
+    return b->req.status == 0 ? 0 : -1;
+}
+
+// wake the flusher if there are too many dirty blocks or old ones.
+// also called from the timer interrupt, see bcache_init()
+static void flush_check(void)
+{
+    if (ndirty >= BCACHE_DIRTY_HIGH ||
+        (ndirty > 0 && ticks_to_us((uint32_t)(read_mtime() - oldest_dirty)) >= BCACHE_FLUSH_MS * 1000)) {
+        flush_wanted = 1;
+        wait_queue_wake_one(&flush_wait);
+    }
+}
+
+void brelse(Buf* b)
+{
+    mutex_unlock(&b->lock);
+    b->refcnt--;
+    if (b->refcnt == 0) {
+        lru_unlink(b);
+        lru_push_front(b);
+    }
+
+    flush_check();
+}
+
+// write every dirty, unlocked block with as many requests in flight as
+// the disk queue takes, then wait for all of them
+void bsync(void)
+{
+    Buf* batch[NBUF];
+    int n = 0;
+
+    mutex_lock(&flush_lock);
+    uint64_t start = read_mtime();
+    for (int i = 0; i < NBUF; i++) {
+        Buf* b = &bufs[i];
+        if (b->dirty && !b->io && !b->lock.locked) {
+            b->dirty = 0;
+            ndirty--;
+            b->refcnt++;
+            if (bcache_submit(b, 1) < 0) {
+                b->dirty = 1;
+                ndirty++;
+                b->refcnt--;
+                continue;
+            }
+            batch[n++] = b;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        bcache_wait_io(batch[i]);
+        batch[i]->refcnt--;
+    }
+    if (ndirty > 0) {
+        oldest_dirty = read_mtime();
+    }
+
+    uint32_t us = ticks_to_us((uint32_t)(read_mtime() - start));
+    stat.flushes++;
+    stat.flushed_blocks += n;
+    stat.flush_last_us = us;
+    if (us > stat.flush_max_us) {
+        stat.flush_max_us = us;
+    }
+    mutex_unlock(&flush_lock);
+}
+
+static void bcache_flusher(void)
+{
+    while (1) {
+        // interrupts off between the test and the sleep, or a kick
+        // from the timer could come in between and be lost
+        reg intr = intr_off();
+        while (!flush_wanted) {
+            wait_queue_sleep(&flush_wait);
+        }
+        flush_wanted = 0;
+        intr_restore(intr);
+        bsync();
+    }
+}
+
+void bcache_init(void)
+{
+    for (int i = 0; i < NBUF; i++) {
+        Buf* b = &bufs[i];
+        b->dev = -1;
+        b->data = NULL;
+        mutex_init(&b->lock, 0);
+        wait_queue_init(&b->io_wait);
+        lru_push_front(b);
+    }
+    wait_queue_init(&flush_wait);
+    mutex_init(&flush_lock, 0);
+    ra_state.last = 0xffffffff;
+
+    if (virtio_blk_capacity()) {
+        CREATE_A_PROCESS(bcache_flusher);
+        // a dirty block waits at most 1.5 * BCACHE_FLUSH_MS
+        timer_periodic(flush_check, BCACHE_FLUSH_MS * 1000 / 2);
+    }
+}
+
+void bcache_stat(void)
+{
+    uint32_t lookups = stat.hits + stat.misses;
+    int used = 0;
+    for (int i = 0; i < NBUF; i++) {
+        if (bufs[i].dev >= 0) used++;
+    }
+
+    mini_printf("buffers:    %d of %d in use (%d KiB each)\n", used, NBUF, BLOCK_SIZE / 1024);
+    mini_printf("lookups:    %u, hits %u, misses %u", lookups, stat.hits, stat.misses);
+    if (lookups) {
+        mini_printf(", hit ratio %u%%", stat.hits * 100 / lookups);
+    }
+    mini_printf("\n");
+    mini_printf("read-ahead: %u issued, %u used, window %d\n",
+                stat.ra_issued, stat.ra_hits, ra_state.window);
+    mini_printf("evictions:  %u\n", stat.evictions);
+    mini_printf("dirty:      %d\n", ndirty);
+    mini_printf("flushes:    %u (%u blocks), last %u us, max %u us\n",
+                stat.flushes, stat.flushed_blocks, stat.flush_last_us, stat.flush_max_us);
+}
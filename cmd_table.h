@@ -9,7 +9,24 @@ void cmd_help(int argc, char *argv[]);
 void cmd_echo(int argc, char *argv[]);
 void cmd_clear(int argc, char *argv[]);
 void cmd_info(int argc, char *argv[]);
-// void cmd_exec(int argc, char *argv[]);
+void cmd_ipcbench(int argc, char *argv[]);
+void cmd_blkbench(int argc, char *argv[]);
+void cmd_cachestat(int argc, char *argv[]);
+void cmd_sync(int argc, char *argv[]);
+void cmd_irqstat(int argc, char *argv[]);
+void cmd_edf(int argc, char *argv[]);
+void cmd_lat(int argc, char *argv[]);
+void cmd_ls(int argc, char *argv[]);
+void cmd_cat(int argc, char *argv[]);
+void cmd_write(int argc, char *argv[]);
+void cmd_stat(int argc, char *argv[]);
+void cmd_exec(int argc, char *argv[]);
+void cmd_loglevel(int argc, char *argv[]);
+void cmd_dmesg(int argc, char *argv[]);
+void cmd_bulk(int argc, char *argv[]);
+void cmd_conbench(int argc, char *argv[]);
+void cmd_stacks(int argc, char *argv[]);
+void cmd_pagestat(int argc, char *argv[]);
 
 // TABLE OF REGISTRATION FOR COMMANDS
 command commands[] = {
@@ -17,7 +34,24 @@ command commands[] = {
     {"echo", cmd_echo, "return parameters"},
     {"clear", cmd_clear, "clear all info"},
     {"info", cmd_info, "view the system-info"},
-    // {"./", cmd_exec, "execute the file"},
+    {"ipcbench", cmd_ipcbench, "ipc ping-pong benchmark: ipcbench [rounds] [page]"},
+    {"blkbench", cmd_blkbench, "disk throughput: blkbench [requests] [w] (w overwrites the disk!)"},
+    {"cachestat", cmd_cachestat, "block cache hit ratio, dirty blocks and flush latency"},
+    {"sync", cmd_sync, "write all dirty blocks to disk"},
+    {"irqstat", cmd_irqstat, "per-irq interrupt counts and handler cycles"},
+    {"edf", cmd_edf, "EDF tasks and deadline misses: edf [runtime period [deadline [jobs]]] (us, starts a busy task, 1000 jobs by default)"},
+    {"lat", cmd_lat, "wakeup and interrupt latency p50/p99/max: lat [reset]"},
+    {"ls", cmd_ls, "list a directory: ls [path]"},
+    {"cat", cmd_cat, "print a file: cat [-t] <file> (-t: time it instead)"},
+    {"write", cmd_write, "write text to a file: write <file> <text...>"},
+    {"stat", cmd_stat, "show an inode and its lookup time: stat <path>"},
+    {"exec", cmd_exec, "run a program from the initramfs: exec [program [args...]] (lists them without one)"},
+    {"loglevel", cmd_loglevel, "show or set the log level: loglevel [none|err|warn|info|debug]"},
+    {"dmesg", cmd_dmesg, "print the kernel log"},
+    {"bulk", cmd_bulk, "run a command with its output on the virtio console: bulk [command...] (stats without one)"},
+    {"conbench", cmd_conbench, "virtio console vs UART throughput: conbench [KiB]"},
+    {"stacks", cmd_stacks, "stack size, deepest use and overflows per process"},
+    {"pagestat", cmd_pagestat, "free pages and per-hart magazine hit rates: pagestat [bench [rounds [burst]]]"},
     {NULL, NULL, NULL} 
 };
 
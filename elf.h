@@ -0,0 +1,67 @@
+#ifndef __ELF_H__
+#define __ELF_H__
+#include "type.h"
+
+/*
+    ELF executable format, just what exec.c needs.
+    the class follows the target: ELF32 on rv32, ELF64 on rv64.
+*/
+
+#define ELF_MAGIC 0x464C457F        // "\x7fELF", little endian
+#define ELFCLASS32 1
+#define ELFCLASS64 2
+#define ET_EXEC 2
+#define EM_RISCV 243
+
+#define PT_LOAD 1
+
+// segment flags
+#define PF_X 1
+#define PF_W 2
+#define PF_R 4
+
+typedef struct {
+    uint32_t magic;
+    uint8_t elf[12];                // class, data, version, abi, padding
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    ptr entry;
+    ptr phoff;
+    ptr shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} Elf_Ehdr;
+
+#if __riscv_xlen == 64
+#define ELFCLASS ELFCLASS64
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+} Elf_Phdr;
+#else
+#define ELFCLASS ELFCLASS32
+typedef struct {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} Elf_Phdr;
+#endif
+
+#endif
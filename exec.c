@@ -0,0 +1,371 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+#include "elf.h"
+#include "syscall.h"
+
+/*
+    EXEC
+    runs ELF programs from the initramfs as processes in U-mode, each
+    with its own page table (vm.c). exec only checks the headers and
+    sets up the arguments, every other page is mapped on its first
+    page fault:
+    - read-only segments map the archive pages themselves, no copy,
+      except a partial last page, which is copied like writable ones.
+    - writable segments get a fresh page with their file bytes.
+    - the stack is zero-filled on demand below USER_STACK_TOP.
+    so starting a program costs the pages it touches, not its size.
+
+    user programs are linked by user/user.ld: code at USER_BASE and
+    every segment starting on its own page.
+*/
+
+#define USER_STACK_TOP 0x40000000L
+#define USER_STACK_PAGES 16
+#define USER_MAX_SEGS 4
+#define USER_MAX_ARGS 8
+#define NUPROC 4                   // programs running at once
+
+// registers of a trapped user program, built by trap_vector.S
+typedef struct UserFrame {
+    reg x[32];                 // x[0] is unused
+    reg mepc;
+    reg pad[3];                // UFRAME_SIZE, a multiple of 16 bytes
+} UserFrame;
+
+typedef struct UserSeg {
+    ptr vaddr;
+    ptr memsz;
+    ptr filesz;
+    ptr offset;                // in the ELF file
+    int perm;                  // PTE_R/W/X
+} UserSeg;
+
+typedef struct UserProc {
+    int used;
+    const char* name;
+    const uint8_t* image;      // the ELF file, inside the initramfs
+    pte_t* pagetable;
+    ptr entry;
+    ptr sp;
+    ptr argv;
+    int argc;
+    int nseg;
+    UserSeg seg[USER_MAX_SEGS];
+    int exit_code;
+    Semaphore done;            // up'ed when the program is gone
+    uint64_t exec_time;
+    uint64_t start_time;       // first user instruction
+    uint32_t inplace;          // page faults served from the archive
+    uint32_t copied;           // ... by copying file bytes
+    uint32_t zeroed;           // ... with a zero page
+} UserProc;
+
+static UserProc uprocs[NUPROC];
+
+extern void user_return(UserFrame* f);
+
+// map the page holding va, 0 if it is mapped now
+static int user_fault(UserProc* up, ptr va)
+{
+    ptr page_va = va & ~(ptr)(PAGE_SIZE - 1);
+    pte_t* pte = uvm_walk(up->pagetable, page_va, 0);
+    if (pte && (*pte & PTE_V)) {
+        return -1;  // mapped, but not for this kind of access
+    }
+
+    for (int i = 0; i < up->nseg; i++) {
+        UserSeg* s = &up->seg[i];
+        if (va < s->vaddr || va >= s->vaddr + s->memsz) {
+            continue;
+        }
+
+        // where this page lives in the archive, if the file layout
+        // keeps pages intact (see mkfs/mkinitramfs.c). only whole
+        // pages of file bytes: the rest of a partial page is the next
+        // archive entry or kernel memory, so tail pages are copied.
+        ptr src = (ptr)up->image + s->offset - s->vaddr + page_va;
+        if (!(s->perm & PTE_W) && (src & (PAGE_SIZE - 1)) == 0 &&
+            page_va >= s->vaddr && page_va + PAGE_SIZE <= s->vaddr + s->filesz) {
+            if (uvm_map(up->pagetable, page_va, (void*)src, s->perm) < 0) {
+                return -1;
+            }
+            up->inplace++;
+            return 0;
+        }
+
+        uint8_t* page = page_alloc(1);
+        if (!page) {
+            return -1;
+        }
+        memset(page, 0, PAGE_SIZE);
+        ptr from = page_va > s->vaddr ? page_va : s->vaddr;
+        ptr to = s->vaddr + s->filesz;
+        if (to > page_va + PAGE_SIZE) {
+            to = page_va + PAGE_SIZE;
+        }
+        if (from < to) {
+            memcpy(page + (from - page_va), up->image + s->offset + (from - s->vaddr), to - from);
+        }
+        if (uvm_map(up->pagetable, page_va, page, s->perm | PTE_OWNED) < 0) {
+            page_free(page);
+            return -1;
+        }
+        if (s->perm & PTE_X) {
+            fence_i();
+        }
+        up->copied++;
+        return 0;
+    }
+
+    if (va < USER_STACK_TOP && va >= USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE) {
+        uint8_t* page = page_alloc(1);
+        if (!page) {
+            return -1;
+        }
+        memset(page, 0, PAGE_SIZE);
+        if (uvm_map(up->pagetable, page_va, page, PTE_R | PTE_W | PTE_OWNED) < 0) {
+            page_free(page);
+            return -1;
+        }
+        up->zeroed++;
+        return 0;
+    }
+    return -1;
+}
+
+// kernel address of user va, faulting its page in if needed
+static void* user_ptr(UserProc* up, ptr va, int perm)
+{
+    void* pa = uvm_translate(up->pagetable, va, perm);
+    if (!pa && user_fault(up, va) == 0) {
+        pa = uvm_translate(up->pagetable, va, perm);
+    }
+    return pa;
+}
+
+static int sys_write(UserProc* up, ptr buf, uint32_t len)
+{
+    uint32_t done = 0;
+    while (done < len) {
+        const char* p = user_ptr(up, buf + done, PTE_R);
+        if (!p) {
+            return -1;
+        }
+        uint32_t n = PAGE_SIZE - ((buf + done) & (PAGE_SIZE - 1));
+        if (n > len - done) {
+            n = len - done;
+        }
+        printf_write(p, n);
+        done += n;
+    }
+    return done;
+}
+
+static reg syscall(UserProc* up, UserFrame* f)
+{
+    switch (f->x[17]) {        // a7
+    case SYS_write:
+        return sys_write(up, f->x[11], f->x[12]);
+    case SYS_exit:
+        up->exit_code = (int)f->x[10];
+        process_exit();
+        return 0;
+    case SYS_yield:
+        process_give_up();
+        return 0;
+    case SYS_getpid:
+        return process_pid();
+    default:
+        return -1;
+    }
+}
+
+static void user_kill(UserProc* up, UserFrame* f, reg cause, reg tval)
+{
+    mini_printf("exec: %s killed: mcause %d at %p, address %p\n",
+                up->name, cause, f->mepc, tval);
+    up->exit_code = -1;
+    process_exit();
+}
+
+// every trap from U-mode, called by user_trap_vector (trap_vector.S)
+// with interrupts off. returning goes back to the program.
+void user_trap(UserFrame* f, reg entry_cycle)
+{
+    UserProc* up = process_user();
+    reg cause = r_mcause();
+    reg tval = r_mtval();
+
+    if (cause & MCAUSE_INTR_BIT) {
+        trap_handler(cause, f->mepc, tval, entry_cycle);
+        // user code holds no kernel locks, so it can be preempted here
+        process_give_up();
+    } else if (cause == EXC_U_ECALL) {
+        f->mepc += 4;
+        intr_on();
+        f->x[10] = syscall(up, f);
+        intr_off();
+    } else if (cause == EXC_INST_PAGE_FAULT || cause == EXC_LOAD_PAGE_FAULT ||
+               cause == EXC_STORE_PAGE_FAULT) {
+        if (user_fault(up, tval) < 0) {
+            user_kill(up, f, cause, tval);
+        }
+    } else {
+        user_kill(up, f, cause, tval);
+    }
+
+    // another program may have run in the meantime
+    uvm_switch(up->pagetable);
+}
+
+// process entry of a program: drop to U-mode at its entry point
+static void user_start(void)
+{
+    UserProc* up = process_user();
+    UserFrame f __attribute__((aligned(16)));
+
+    memset(&f, 0, sizeof(f));
+    f.mepc = up->entry;
+    f.x[2] = up->sp;
+    f.x[10] = up->argc;
+    f.x[11] = up->argv;
+
+    intr_off();
+    up->start_time = read_mtime();
+    uvm_switch(up->pagetable);
+    user_return(&f);
+}
+
+static int elf_check(UserProc* up, const uint8_t* image, uint32_t size)
+{
+    const Elf_Ehdr* eh = (const Elf_Ehdr*)image;
+    if (size < sizeof(Elf_Ehdr) || eh->magic != ELF_MAGIC || eh->elf[0] != ELFCLASS ||
+        eh->type != ET_EXEC || eh->machine != EM_RISCV ||
+        eh->phentsize != sizeof(Elf_Phdr) ||
+        eh->phoff + eh->phnum * sizeof(Elf_Phdr) > size) {
+        return -1;
+    }
+
+    up->nseg = 0;
+    for (int i = 0; i < eh->phnum; i++) {
+        const Elf_Phdr* ph = (const Elf_Phdr*)(image + eh->phoff) + i;
+        if (ph->type != PT_LOAD || ph->memsz == 0) {
+            continue;
+        }
+        if (up->nseg == USER_MAX_SEGS || ph->filesz > ph->memsz ||
+            ph->offset + ph->filesz > size || ph->vaddr + ph->memsz < ph->vaddr ||
+            ph->vaddr + ph->memsz > USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE) {
+            return -1;
+        }
+        UserSeg* s = &up->seg[up->nseg++];
+        s->vaddr = ph->vaddr;
+        s->memsz = ph->memsz;
+        s->filesz = ph->filesz;
+        s->offset = ph->offset;
+        s->perm = 0;
+        if (ph->flags & (PF_R | PF_W)) s->perm |= PTE_R;   // W without R is reserved
+        if (ph->flags & PF_W) s->perm |= PTE_W;
+        if (ph->flags & PF_X) s->perm |= PTE_X;
+    }
+    up->entry = eh->entry;
+    return up->nseg ? 0 : -1;
+}
+
+// copy the argument strings and argv[] to the top of the user stack
+static int user_args(UserProc* up, int argc, char* argv[])
+{
+    ptr top_page = USER_STACK_TOP - PAGE_SIZE;
+    if (user_fault(up, top_page) < 0) {
+        return -1;
+    }
+    uint8_t* page = uvm_translate(up->pagetable, top_page, PTE_W);
+    ptr uargv[USER_MAX_ARGS + 1];
+    ptr sp = USER_STACK_TOP;
+
+    if (argc > USER_MAX_ARGS) {
+        argc = USER_MAX_ARGS;
+    }
+    for (int i = argc - 1; i >= 0; i--) {
+        uint32_t len = strlen(argv[i]) + 1;
+        if (sp - len < top_page + PAGE_SIZE / 2) {
+            return -1;
+        }
+        sp -= len;
+        memcpy(page + (sp - top_page), argv[i], len);
+        uargv[i] = sp;
+    }
+    uargv[argc] = 0;
+
+    sp &= ~(ptr)(sizeof(ptr) - 1);
+    sp -= (argc + 1) * sizeof(ptr);
+    memcpy(page + (sp - top_page), uargv, (argc + 1) * sizeof(ptr));
+    up->argv = sp;
+    up->argc = argc;
+    up->sp = sp & ~(ptr)0xF;
+    return 0;
+}
+
+// run argv[0] from the initramfs and wait for it, returns its exit code
+int exec_program(int argc, char* argv[])
+{
+    uint64_t start = read_mtime();
+    uint32_t size;
+    const uint8_t* image = initramfs_find(argv[0], &size);
+    if (!image) {
+        mini_printf("exec: %s: not found\n", argv[0]);
+        return -1;
+    }
+
+    UserProc* up = NULL;
+    for (int i = 0; i < NUPROC; i++) {
+        if (!uprocs[i].used) {
+            up = &uprocs[i];
+            break;
+        }
+    }
+    if (!up) {
+        mini_printf("exec: too many programs\n");
+        return -1;
+    }
+
+    memset(up, 0, sizeof(*up));
+    up->name = argv[0];
+    up->image = image;
+    up->exec_time = start;
+    if (elf_check(up, image, size) < 0) {
+        mini_printf("exec: %s: not a RISC-V executable for this kernel\n", argv[0]);
+        return -1;
+    }
+    up->pagetable = uvm_create();
+    if (!up->pagetable || user_args(up, argc, argv) < 0) {
+        mini_printf("exec: %s: out of memory\n", argv[0]);
+        uvm_free(up->pagetable);
+        return -1;
+    }
+    sem_init(&up->done, 0);
+    up->used = 1;
+
+    if (!CREATE_USER_PROCESS(user_start, up)) {
+        uvm_free(up->pagetable);
+        up->used = 0;
+        return -1;
+    }
+    sem_down(&up->done);
+
+    mini_printf("exec: %s exited with %d, startup %u us, %u KiB file\n",
+                argv[0], up->exit_code,
+                ticks_to_us((uint32_t)(up->start_time - up->exec_time)), size / 1024);
+    mini_printf("      page faults: %u in place, %u copied, %u zero-filled\n",
+                up->inplace, up->copied, up->zeroed);
+    up->used = 0;
+    return up->exit_code;
+}
+
+// the program's process is exiting (process_exit)
+void exec_release(UserProc* up)
+{
+    w_satp(0);
+    uvm_free(up->pagetable);
+    up->pagetable = NULL;
+    sem_up(&up->done);
+}
@@ -0,0 +1,659 @@
+#include "kernel_func.h"
+#include "fs.h"
+
+/*
+    FILE SYSTEM
+    on-disk format in fs.h. every block goes through the buffer
+    cache (bcache.c), inodes go through the inode cache below.
+
+    the inode cache is a hash of (dev, inum) over NINODE slots.
+    iget() only takes a reference, ilock() reads the disk inode the
+    first time and locks it, like xv6 does.
+*/
+
+#define INODE_BUCKETS 17
+
+static int fs_dev = -1;
+static struct superblock sb;
+
+static Inode itable[NINODE];
+static Inode* ibuckets[INODE_BUCKETS];
+static Mutex itable_lock;
+
+
+// BLOCK BITMAP
+// mark blocks [start, start + len) used or free, -1 if a bitmap
+// block cannot be read (the bits before it are changed already)
+static int bitmap_set(uint32_t start, uint32_t len, int used)
+{
+    Buf* bp = NULL;
+    uint32_t bp_blk = 0;
+
+    for (uint32_t b = start; b < start + len; b++) {
+        uint32_t blk = sb.bmap_start + b / BPB;
+        if (!bp || blk != bp_blk) {
+            if (bp) {
+                bdirty(bp);
+                brelse(bp);
+            }
+            bp = bread(fs_dev, blk);
+            if (!bp) {
+                mini_printf("fs: cannot read bitmap block %u\n", blk);
+                return -1;
+            }
+            bp_blk = blk;
+        }
+        uint32_t bit = b % BPB;
+        if (used) {
+            bp->data[bit / 8] |= (1 << (bit % 8));
+        } else {
+            bp->data[bit / 8] &= ~(1 << (bit % 8));
+        }
+    }
+    if (bp) {
+        bdirty(bp);
+        brelse(bp);
+    }
+    return 0;
+}
+
+// find up to `want` free blocks in one run, trying `goal` first so a
+// growing file extends its last extent. returns the start and the
+// length in *got, 0 when the disk is full or the bitmap unreadable.
+static uint32_t balloc(uint32_t goal, uint32_t want, uint32_t* got)
+{
+    uint32_t best_start = 0, best_len = 0;
+    uint32_t first = (goal >= sb.data_start && goal < sb.size) ? goal : sb.data_start;
+
+    // [first, size) then wrap around to [data_start, first)
+    for (int pass = 0; pass < 2 && best_len < want; pass++) {
+        uint32_t from = pass == 0 ? first : sb.data_start;
+        uint32_t to = pass == 0 ? sb.size : first;
+        uint32_t run_start = 0, run_len = 0;
+        Buf* bp = NULL;
+        uint32_t bp_blk = 0;
+
+        for (uint32_t b = from; b < to; b++) {
+            uint32_t blk = sb.bmap_start + b / BPB;
+            if (!bp || blk != bp_blk) {
+                if (bp) brelse(bp);
+                bp = bread(fs_dev, blk);
+                if (!bp) {
+                    mini_printf("fs: cannot read bitmap block %u\n", blk);
+                    return 0;
+                }
+                bp_blk = blk;
+            }
+            uint32_t bit = b % BPB;
+            if (bp->data[bit / 8] & (1 << (bit % 8))) {
+                run_len = 0;
+                continue;
+            }
+            if (run_len == 0) {
+                run_start = b;
+            }
+            run_len++;
+            if (run_len > best_len) {
+                best_start = run_start;
+                best_len = run_len;
+                if (best_len == want) break;
+            }
+        }
+        if (bp) brelse(bp);
+    }
+
+    if (best_len == 0) {
+        mini_printf("fs: disk full\n");
+        return 0;
+    }
+    if (bitmap_set(best_start, best_len, 1) < 0) {
+        bitmap_set(best_start, best_len, 0);   // undo what was marked
+        return 0;
+    }
+    *got = best_len;
+    return best_start;
+}
+
+
+// INODE CACHE
+static uint32_t ihash(int dev, uint32_t inum)
+{
+    return (inum ^ (dev << 24)) % INODE_BUCKETS;
+}
+
+// reference the cached inode, claiming a free slot on a miss
+Inode* iget(int dev, uint32_t inum)
+{
+    mutex_lock(&itable_lock);
+    for (Inode* ip = ibuckets[ihash(dev, inum)]; ip; ip = ip->hash_next) {
+        if (ip->dev == dev && ip->inum == inum) {
+            ip->ref++;
+            mutex_unlock(&itable_lock);
+            return ip;
+        }
+    }
+
+    Inode* ip = NULL;
+    for (int i = 0; i < NINODE; i++) {
+        if (itable[i].ref == 0) {
+            ip = &itable[i];
+            break;
+        }
+    }
+    if (!ip) {
+        mutex_unlock(&itable_lock);
+        mini_printf("fs: inode cache full\n");
+        return NULL;
+    }
+
+    // unhash the old identity of the slot
+    if (ip->dev >= 0) {
+        Inode** pp = &ibuckets[ihash(ip->dev, ip->inum)];
+        while (*pp != ip) pp = &(*pp)->hash_next;
+        *pp = ip->hash_next;
+    }
+    ip->dev = dev;
+    ip->inum = inum;
+    ip->ref = 1;
+    ip->valid = 0;
+    ip->hash_next = ibuckets[ihash(dev, inum)];
+    ibuckets[ihash(dev, inum)] = ip;
+    mutex_unlock(&itable_lock);
+    return ip;
+}
+
+// the slot stays hashed with its contents, a later iget() of the same
+// inode is a hit until the slot gets reused
+void iput(Inode* ip)
+{
+    mutex_lock(&itable_lock);
+    ip->ref--;
+    mutex_unlock(&itable_lock);
+}
+
+void ilock(Inode* ip)
+{
+    mutex_lock(&ip->lock);
+    if (!ip->valid) {
+        Buf* bp = bread(ip->dev, sb.inode_start + ip->inum / IPB);
+        if (bp) {
+            memcpy(&ip->d, (struct dinode*)bp->data + ip->inum % IPB, sizeof(ip->d));
+            brelse(bp);
+            ip->valid = 1;
+        }
+    }
+}
+
+void iunlock(Inode* ip)
+{
+    mutex_unlock(&ip->lock);
+}
+
+// copy the in-memory inode back to its disk block (write-back)
+static void iupdate(Inode* ip)
+{
+    Buf* bp = bread(ip->dev, sb.inode_start + ip->inum / IPB);
+    if (!bp) return;
+    memcpy((struct dinode*)bp->data + ip->inum % IPB, &ip->d, sizeof(ip->d));
+    bdirty(bp);
+    brelse(bp);
+}
+
+static uint32_t ialloc_hint = ROOT_INUM;  // inodes below are known to be taken
+
+static Inode* ialloc(int type)
+{
+    for (uint32_t inum = ialloc_hint; inum < sb.ninodes; inum++) {
+        Buf* bp = bread(fs_dev, sb.inode_start + inum / IPB);
+        if (!bp) return NULL;
+        struct dinode* dip = (struct dinode*)bp->data + inum % IPB;
+        if (dip->type == T_FREE) {
+            memset(dip, 0, sizeof(*dip));
+            dip->type = type;
+            dip->nlink = 1;
+            bdirty(bp);
+            brelse(bp);
+            ialloc_hint = inum + 1;
+            Inode* ip = iget(fs_dev, inum);
+            if (ip) ip->valid = 0;   // drop any stale cached copy
+            return ip;
+        }
+        brelse(bp);
+    }
+    mini_printf("fs: out of inodes\n");
+    return NULL;
+}
+
+// give back an inode from ialloc() that never got linked, drops the reference
+static void ifree(Inode* ip)
+{
+    ilock(ip);
+    ip->d.type = T_FREE;
+    ip->d.nlink = 0;
+    iupdate(ip);
+    iunlock(ip);
+    if (ip->inum < ialloc_hint) {
+        ialloc_hint = ip->inum;
+    }
+    iput(ip);
+}
+
+
+// EXTENTS
+// disk block of file block fb, 0 if not allocated. ip locked.
+static uint32_t bmap(Inode* ip, uint32_t fb)
+{
+    for (uint32_t i = 0; i < ip->d.nextents; i++) {
+        struct extent* e = &ip->d.ext[i];
+        if (fb < e->len) {
+            return e->start + fb;
+        }
+        fb -= e->len;
+    }
+    return 0;
+}
+
+static uint32_t iblocks(Inode* ip)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ip->d.nextents; i++) {
+        n += ip->d.ext[i].len;
+    }
+    return n;
+}
+
+// make sure the file owns at least nblocks blocks, allocating
+// them as few runs as possible. ip locked.
+static int iextend(Inode* ip, uint32_t nblocks)
+{
+    uint32_t have = iblocks(ip);
+    while (have < nblocks) {
+        struct extent* last = ip->d.nextents ? &ip->d.ext[ip->d.nextents - 1] : NULL;
+        uint32_t goal = last ? last->start + last->len : 0;
+        uint32_t got;
+        uint32_t start = balloc(goal, nblocks - have, &got);
+        if (!start) {
+            return -1;      // balloc() said why
+        }
+
+        if (last && start == goal) {
+            last->len += got;                  // grew in place
+        } else if (ip->d.nextents < NEXTENT) {
+            ip->d.ext[ip->d.nextents].start = start;
+            ip->d.ext[ip->d.nextents].len = got;
+            ip->d.nextents++;
+        } else {
+            bitmap_set(start, got, 0);
+            mini_printf("fs: file too fragmented\n");
+            return -1;
+        }
+        have += got;
+    }
+    return 0;
+}
+
+
+// FILE DATA
+// read n bytes at off, returns bytes read. ip locked.
+int readi(Inode* ip, void* dst, uint32_t off, uint32_t n)
+{
+    if (off >= ip->d.size) {
+        return 0;
+    }
+    if (n > ip->d.size - off) {
+        n = ip->d.size - off;
+    }
+
+    uint32_t done = 0;
+    while (done < n) {
+        uint32_t blk = bmap(ip, off / FS_BLOCK_SIZE);
+        Buf* bp = blk ? bread(ip->dev, blk) : NULL;
+        if (!bp) break;
+
+        uint32_t in_blk = off % FS_BLOCK_SIZE;
+        uint32_t m = FS_BLOCK_SIZE - in_blk;
+        if (m > n - done) m = n - done;
+        memcpy((uint8_t*)dst + done, bp->data + in_blk, m);
+        brelse(bp);
+
+        done += m;
+        off += m;
+    }
+    return done;
+}
+
+// write n bytes at off, growing the file. returns bytes written. ip locked.
+int writei(Inode* ip, const void* src, uint32_t off, uint32_t n)
+{
+    if (off > ip->d.size) {
+        return -1;
+    }
+    uint32_t end = off + n;
+    if (iextend(ip, (end + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE) < 0) {
+        return -1;
+    }
+
+    uint32_t done = 0;
+    while (done < n) {
+        Buf* bp = bread(ip->dev, bmap(ip, off / FS_BLOCK_SIZE));
+        if (!bp) break;
+
+        uint32_t in_blk = off % FS_BLOCK_SIZE;
+        uint32_t m = FS_BLOCK_SIZE - in_blk;
+        if (m > n - done) m = n - done;
+        memcpy(bp->data + in_blk, (const uint8_t*)src + done, m);
+        bdirty(bp);
+        brelse(bp);
+
+        done += m;
+        off += m;
+    }
+
+    if (off > ip->d.size) {
+        ip->d.size = off;
+    }
+    iupdate(ip);
+    return done;
+}
+
+// file becomes n bytes long, blocks beyond stay allocated for reuse
+void itrunc(Inode* ip, uint32_t n)
+{
+    if (n < ip->d.size) {
+        ip->d.size = n;
+        iupdate(ip);
+    }
+}
+
+
+// HASHED DIRECTORIES
+static uint32_t dir_buckets(Inode* dp)
+{
+    return dp->d.size / FS_BLOCK_SIZE;
+}
+
+static int dirent_match(struct dirent* de, const char* name, int len)
+{
+    return de->inum && de->name_len == len && memcmp(de->name, name, len) == 0;
+}
+
+// inode number of name in directory dp, 0 if missing. dp locked.
+static uint32_t dir_lookup(Inode* dp, const char* name, int len)
+{
+    uint32_t nb = dir_buckets(dp);
+    if (nb == 0) {
+        return 0;
+    }
+
+    uint32_t home = fs_name_hash(name, len) % nb;
+    for (uint32_t probe = 0; probe < nb; probe++) {
+        Buf* bp = bread(dp->dev, bmap(dp, (home + probe) % nb));
+        if (!bp) return 0;
+        struct dirbucket* bucket = (struct dirbucket*)bp->data;
+
+        for (int i = 0; i < DIRENTS_PER_BUCKET; i++) {
+            if (dirent_match(&bucket->ent[i], name, len)) {
+                uint32_t inum = bucket->ent[i].inum;
+                brelse(bp);
+                return inum;
+            }
+        }
+        int overflow = bucket->hdr.overflow;
+        brelse(bp);
+        if (!overflow) {
+            break;   // nothing was ever pushed past this bucket
+        }
+    }
+    return 0;
+}
+
+// put (name, inum) into the bucket array at buckets[0..nb) of dp,
+// probing linearly from the home bucket
+static int bucket_insert(Inode* dp, uint32_t first, uint32_t nb,
+                         const char* name, int len, uint32_t inum)
+{
+    uint32_t home = fs_name_hash(name, len) % nb;
+    for (uint32_t probe = 0; probe < nb; probe++) {
+        Buf* bp = bread(dp->dev, bmap(dp, first + (home + probe) % nb));
+        if (!bp) return -1;
+        struct dirbucket* bucket = (struct dirbucket*)bp->data;
+
+        if (bucket->hdr.count < DIRENTS_PER_BUCKET) {
+            for (int i = 0; i < DIRENTS_PER_BUCKET; i++) {
+                struct dirent* de = &bucket->ent[i];
+                if (de->inum == 0) {
+                    de->inum = inum;
+                    de->name_len = len;
+                    memcpy(de->name, name, len);
+                    bucket->hdr.count++;
+                    break;
+                }
+            }
+            bdirty(bp);
+            brelse(bp);
+            return 0;
+        }
+        bucket->hdr.overflow = 1;
+        bdirty(bp);
+        brelse(bp);
+    }
+    return -1;
+}
+
+static void zero_blocks(Inode* dp, uint32_t first, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        Buf* bp = bread(dp->dev, bmap(dp, first + i));
+        if (!bp) continue;
+        memset(bp->data, 0, FS_BLOCK_SIZE);
+        bdirty(bp);
+        brelse(bp);
+    }
+}
+
+// double the buckets of dp and rehash every entry into them.
+// the new buckets are appended, then the old ones are dropped from
+// the front of the extent list. dp locked.
+static int dir_grow(Inode* dp)
+{
+    uint32_t old_nb = dir_buckets(dp);
+    uint32_t new_nb = old_nb ? old_nb * 2 : 1;
+
+    if (iextend(dp, old_nb + new_nb) < 0) {
+        return -1;
+    }
+    zero_blocks(dp, old_nb, new_nb);
+
+    for (uint32_t b = 0; b < old_nb; b++) {
+        Buf* bp = bread(dp->dev, bmap(dp, b));
+        if (!bp) return -1;
+        struct dirbucket* bucket = (struct dirbucket*)bp->data;
+        for (int i = 0; i < DIRENTS_PER_BUCKET; i++) {
+            struct dirent* de = &bucket->ent[i];
+            // on failure the old buckets are untouched and d.size
+            // still covers only them, the new blocks stay allocated
+            // past the end for the next attempt (like itrunc)
+            if (de->inum &&
+                bucket_insert(dp, old_nb, new_nb, de->name, de->name_len, de->inum) < 0) {
+                brelse(bp);
+                return -1;
+            }
+        }
+        brelse(bp);
+    }
+
+    // release the first old_nb blocks of the extent list
+    uint32_t drop = old_nb;
+    while (drop > 0) {
+        struct extent* e = &dp->d.ext[0];
+        uint32_t n = e->len < drop ? e->len : drop;
+        bitmap_set(e->start, n, 0);
+        e->start += n;
+        e->len -= n;
+        drop -= n;
+        if (e->len == 0) {
+            for (uint32_t i = 1; i < dp->d.nextents; i++) {
+                dp->d.ext[i - 1] = dp->d.ext[i];
+            }
+            dp->d.nextents--;
+        }
+    }
+    dp->d.size = new_nb * FS_BLOCK_SIZE;
+    iupdate(dp);
+    return 0;
+}
+
+static int dir_link(Inode* dp, const char* name, int len, uint32_t inum)
+{
+    uint32_t nb = dir_buckets(dp);
+    if ((dp->d.nentries + 1) * 100 > nb * DIRENTS_PER_BUCKET * DIR_MAX_LOAD) {
+        if (dir_grow(dp) < 0) {
+            return -1;
+        }
+        nb = dir_buckets(dp);
+    }
+    if (bucket_insert(dp, 0, nb, name, len, inum) < 0) {
+        return -1;
+    }
+    dp->d.nentries++;
+    iupdate(dp);
+    return 0;
+}
+
+// call fn for every entry of directory dp. dp locked.
+int dir_iterate(Inode* dp, void (*fn)(const char* name, int len, uint32_t inum, void* arg), void* arg)
+{
+    int n = 0;
+    for (uint32_t b = 0; b < dir_buckets(dp); b++) {
+        Buf* bp = bread(dp->dev, bmap(dp, b));
+        if (!bp) break;
+        struct dirbucket* bucket = (struct dirbucket*)bp->data;
+        for (int i = 0; i < DIRENTS_PER_BUCKET; i++) {
+            struct dirent* de = &bucket->ent[i];
+            if (de->inum) {
+                fn(de->name, de->name_len, de->inum, arg);
+                n++;
+            }
+        }
+        brelse(bp);
+    }
+    return n;
+}
+
+
+// PATHS
+// copy the next element of path into name, return the rest or NULL
+static const char* skip_elem(const char* path, const char** name, int* len)
+{
+    while (*path == '/') path++;
+    if (*path == '\0') return NULL;
+
+    *name = path;
+    while (*path && *path != '/') path++;
+    *len = path - *name;
+    return path;
+}
+
+// walk path; with parent set, stop one element early and return the
+// final name in name/len. returns a referenced, unlocked inode.
+static Inode* namex(const char* path, int parent, const char** name, int* len)
+{
+    if (fs_dev < 0) {
+        return NULL;
+    }
+
+    const char* elem;
+    int elen;
+    Inode* ip = iget(fs_dev, ROOT_INUM);
+
+    while (ip && (path = skip_elem(path, &elem, &elen)) != NULL) {
+        if (elen > FS_NAME_LEN) {
+            iput(ip);
+            return NULL;
+        }
+        ilock(ip);
+        if (ip->d.type != T_DIR) {
+            iunlock(ip);
+            iput(ip);
+            return NULL;
+        }
+        if (parent && skip_elem(path, name, len) == NULL) {
+            *name = elem;
+            *len = elen;
+            iunlock(ip);
+            return ip;
+        }
+        uint32_t inum = dir_lookup(ip, elem, elen);
+        iunlock(ip);
+        iput(ip);
+        if (!inum) {
+            return NULL;
+        }
+        ip = iget(fs_dev, inum);
+    }
+    if (parent && ip) {
+        iput(ip);
+        return NULL;   // path was "/"
+    }
+    return ip;
+}
+
+Inode* namei(const char* path)
+{
+    return namex(path, 0, NULL, NULL);
+}
+
+// open path, creating an empty file of `type` if it does not exist.
+// returns a referenced, unlocked inode.
+Inode* fs_create(const char* path, int type)
+{
+    const char* name;
+    int len;
+    Inode* dp = namex(path, 1, &name, &len);
+    if (!dp) {
+        return NULL;
+    }
+
+    ilock(dp);
+    uint32_t inum = dir_lookup(dp, name, len);
+    if (inum) {
+        iunlock(dp);
+        iput(dp);
+        return iget(fs_dev, inum);
+    }
+
+    Inode* ip = ialloc(type);
+    if (ip && dir_link(dp, name, len, ip->inum) < 0) {
+        ifree(ip);
+        ip = NULL;
+    }
+    iunlock(dp);
+    iput(dp);
+    return ip;
+}
+
+// mount the file system on dev, 0 if there is none
+int fs_init(int dev)
+{
+    mutex_init(&itable_lock, 0);
+    for (int i = 0; i < NINODE; i++) {
+        itable[i].dev = -1;
+        mutex_init(&itable[i].lock, 0);
+    }
+
+    Buf* bp = bread(dev, FS_SUPER_BLOCK);
+    if (!bp) {
+        return 0;
+    }
+    memcpy(&sb, bp->data, sizeof(sb));
+    brelse(bp);
+
+    if (sb.magic != FS_MAGIC) {
+        mini_printf("fs: no file system on disk %d\n", dev);
+        return 0;
+    }
+    fs_dev = dev;
+    mini_printf("fs: %d blocks, %d inodes, data from block %d\n",
+                sb.size, sb.ninodes, sb.data_start);
+    return 1;
+}
@@ -0,0 +1,99 @@
+#ifndef __FS_H__
+#define __FS_H__
+#include "type.h"
+
+/*
+    SuepOS FILE SYSTEM, on-disk format
+    shared by the kernel (fs.c) and the host tool (mkfs/mkfs.c).
+
+    disk layout, in FS_BLOCK_SIZE blocks (see RQMTS):
+    [ boot block | superblock | inode blocks | bitmap blocks | data blocks ]
+         0            1         inode_start    bmap_start      data_start
+
+    - files are stored as up to NEXTENT extents (start, len), so a
+      file written in one go is one contiguous run and needs a single
+      metadata lookup per block range instead of one per block.
+    - a directory is an array of hash buckets, one block each. a name
+      hashes to one bucket and is found there (or in the next ones if
+      that bucket ever overflowed), so lookup reads about one block no
+      matter how many entries the directory holds.
+*/
+
+#define FS_MAGIC 0x50455553          // "SUEP"
+#define FS_BLOCK_SIZE 4096
+#define FS_SUPER_BLOCK 1
+#define ROOT_INUM 1                  // inode 0 is never used
+
+#define NEXTENT 12
+#define FS_NAME_LEN 56
+
+// inode types
+#define T_FREE 0
+#define T_DIR  1
+#define T_FILE 2
+
+struct superblock {
+    uint32_t magic;
+    uint32_t size;                   // total blocks
+    uint32_t ninodes;
+    uint32_t inode_start;
+    uint32_t ninode_blocks;
+    uint32_t bmap_start;
+    uint32_t nbmap_blocks;
+    uint32_t data_start;
+};
+
+struct extent {
+    uint32_t start;                  // first block
+    uint32_t len;                    // blocks, 0 = unused slot
+};
+
+struct dinode {
+    uint16_t type;
+    uint16_t nlink;
+    uint32_t size;                   // bytes, buckets * FS_BLOCK_SIZE for a dir
+    uint32_t nextents;
+    uint32_t nentries;               // directories: live entries
+    struct extent ext[NEXTENT];
+    uint32_t reserved[4];
+};                                   // 128 bytes
+
+#define IPB (FS_BLOCK_SIZE / sizeof(struct dinode))   // inodes per block
+#define BPB (FS_BLOCK_SIZE * 8)                       // bitmap bits per block
+
+struct dirent {
+    uint32_t inum;                   // 0 = free slot
+    uint8_t name_len;
+    uint8_t pad[3];
+    char name[FS_NAME_LEN];          // not NUL terminated when full
+};                                   // 64 bytes
+
+// first slot of every bucket block
+struct dirbucket_hdr {
+    uint32_t count;                  // used entries in this bucket
+    uint32_t overflow;               // an insert had to probe past it
+    uint8_t pad[sizeof(struct dirent) - 8];
+};
+
+#define DIRENTS_PER_BUCKET (FS_BLOCK_SIZE / sizeof(struct dirent) - 1)
+
+struct dirbucket {
+    struct dirbucket_hdr hdr;
+    struct dirent ent[DIRENTS_PER_BUCKET];
+};
+
+// grow a directory (double its buckets) beyond this load, in percent
+#define DIR_MAX_LOAD 75
+
+// FNV-1a, picks the home bucket of a name
+static inline uint32_t fs_name_hash(const char* name, int len)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#endif
@@ -4,6 +4,19 @@
 
 #define MAX_CPU 8
 
+// register width, for the assembly files (switch.S, trap_vector.S, ...)
+#if __riscv_xlen == 64
+#define REGBYTES 8
+#define REG_S sd
+#define REG_L ld
+#define PTRWORD .dword
+#else
+#define REGBYTES 4
+#define REG_S sw
+#define REG_L lw
+#define PTRWORD .word
+#endif
+
 /*
    memory layout:
        0x00000000 --> +-----------+
@@ -27,7 +40,48 @@
 
 // Memory-mapped I/O addresses for the UART:
 #define UART0 0x10000000L
+#define UART0_IRQ 10
+
+// CLINT (core local interruptor), holds the machine timer:
+#define CLINT 0x02000000L
+#define CLINT_MTIME (CLINT + 0xBFF8)            // cycles since boot
+#define CLINT_MTIMECMP(hart) (CLINT + 0x4000 + 8 * (hart))
+#define TIMER_FREQ 10000000                     // QEMU virt: 10 MHz
+
+// PLIC (platform-level interrupt controller), M-mode context of each hart:
+#define PLIC 0x0C000000L
+#define PLIC_PRIORITY(irq) (PLIC + 4 * (irq))
+#define PLIC_PENDING (PLIC + 0x1000)
+#define PLIC_MENABLE(hart) (PLIC + 0x2000 + 0x100 * (hart))
+#define PLIC_MTHRESHOLD(hart) (PLIC + 0x200000 + 0x2000 * (hart))
+#define PLIC_MCLAIM(hart) (PLIC + 0x200004 + 0x2000 * (hart))
+
+// virtio-mmio transports, one page apart, IRQ 1..8:
+#define VIRTIO0 0x10001000L
+#define VIRTIO_STRIDE 0x1000
+#define VIRTIO_SLOTS 8
+#define VIRTIO0_IRQ 1
 // Main memory size is as follows:
 #define MAIN_MEMORY 64 * 1024 * 1024  // 64 MB of main memory
+#define KERNBASE 0x80000000L
+#define PHYSTOP (KERNBASE + MAIN_MEMORY)
+
+// paging layout, not switched on yet: the kernel runs on physical
+// addresses. rv64 uses Sv39 (3 levels of 9-bit indices, 39-bit
+// virtual addresses), rv32 uses Sv32 (2 levels of 10-bit indices).
+#define PGSHIFT 12
+#if __riscv_xlen == 64
+#define SATP_MODE (8UL << 60)
+#define PT_LEVELS 3
+#define VPN_BITS 9
+// one bit less than Sv39 allows, so addresses never need sign extension
+#define MAXVA (1L << (PGSHIFT + 3 * VPN_BITS - 1))
+#else
+#define SATP_MODE (1UL << 31)
+#define PT_LEVELS 2
+#define VPN_BITS 10
+#endif
+#define PTE_PER_PAGE (1 << VPN_BITS)
+#define PX(level, va) ((((ptr)(va)) >> (PGSHIFT + VPN_BITS * (level))) & (PTE_PER_PAGE - 1))
 
 #endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+
+/*
+    INITRAMFS
+    a cpio archive ("newc" format) linked into the kernel image by
+    initramfs_data.S, built on the host by mkfs/mkinitramfs. that tool
+    pads the archive so the data of every file starts on a page
+    boundary, which lets exec.c map program code straight out of
+    the archive instead of copying it.
+
+    entry: 110-byte ASCII header, name, data, each padded to 4 bytes.
+    the archive ends with an entry named TRAILER!!!.
+*/
+
+#define CPIO_MAGIC "070701"
+#define CPIO_HDR_SIZE 110
+#define CPIO_TRAILER "TRAILER!!!"
+#define CPIO_PAD ".pad"            // alignment filler from mkinitramfs
+
+extern const uint8_t initramfs_start[];
+extern const uint8_t initramfs_end[];
+
+// one 8-digit hex field of the header
+static uint32_t cpio_field(const uint8_t* hdr, int index)
+{
+    const uint8_t* p = hdr + 6 + index * 8;
+    uint32_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        uint8_t c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+    }
+    return v;
+}
+
+#define CPIO_FILESIZE 6
+#define CPIO_NAMESIZE 11
+
+static uint32_t align4(uint32_t n)
+{
+    return (n + 3) & ~3;
+}
+
+// call fn for every file, stop when it returns nonzero
+static const uint8_t* cpio_walk(int (*fn)(const char* name, const uint8_t* data, uint32_t size, void* arg),
+                                void* arg)
+{
+    const uint8_t* p = initramfs_start;
+    while (p + CPIO_HDR_SIZE <= initramfs_end && memcmp(p, CPIO_MAGIC, 6) == 0) {
+        uint32_t namesize = cpio_field(p, CPIO_NAMESIZE);
+        uint32_t filesize = cpio_field(p, CPIO_FILESIZE);
+        const char* name = (const char*)p + CPIO_HDR_SIZE;
+        const uint8_t* data = p + align4(CPIO_HDR_SIZE + namesize);
+
+        if (strcmp(name, CPIO_TRAILER) == 0 || data + filesize > initramfs_end) {
+            break;
+        }
+        if (strcmp(name, CPIO_PAD) != 0 && fn(name, data, filesize, arg)) {
+            return data;
+        }
+        p = data + align4(filesize);
+    }
+    return NULL;
+}
+
+struct find_arg {
+    const char* name;
+    uint32_t size;
+};
+
+static int find_fn(const char* name, const uint8_t* data, uint32_t size, void* arg)
+{
+    struct find_arg* f = arg;
+    if (strcmp(name, f->name) == 0) {
+        f->size = size;
+        return 1;
+    }
+    return 0;
+}
+
+// the data of file `name`, NULL if there is none
+const void* initramfs_find(const char* name, uint32_t* size)
+{
+    struct find_arg f = { name, 0 };
+    const uint8_t* data = cpio_walk(find_fn, &f);
+    if (data && size) {
+        *size = f.size;
+    }
+    return data;
+}
+
+static int list_fn(const char* name, const uint8_t* data, uint32_t size, void* arg)
+{
+    mini_printf("  %s (%u bytes)\n", name, size);
+    (*(int*)arg)++;
+    return 0;
+}
+
+void initramfs_list(void)
+{
+    int n = 0;
+    cpio_walk(list_fn, &n);
+    if (!n) {
+        mini_printf("initramfs is empty\n");
+    }
+}
+
+static int count_fn(const char* name, const uint8_t* data, uint32_t size, void* arg)
+{
+    (*(int*)arg)++;
+    return 0;
+}
+
+void initramfs_init(void)
+{
+    int n = 0;
+    cpio_walk(count_fn, &n);
+    mini_printf("initramfs: %d files, %u KiB at %p\n",
+                n, (uint32_t)(initramfs_end - initramfs_start) / 1024, initramfs_start);
+}
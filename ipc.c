@@ -0,0 +1,225 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+
+/*
+ * MESSAGE-PASSING IPC CHANNELS
+ *
+ * a channel is a bounded ring of IPC_RING_SLOTS messages.
+ * - small payloads (<= IPC_MSG_SIZE bytes) are copied into the ring.
+ * - large payloads travel as whole pages from page_alloc(): only the
+ *   pointer moves, and the receiver becomes the owner of the pages
+ *   (it must page_free() them or send them on).
+ *
+ * send/recv block through the scheduler's wait queues. when a
+ * receiver is already waiting, the sender switches straight to it,
+ * so a request/response round-trip costs one switch each way.
+ */
+
+void channel_init(Channel* ch)
+{
+    ch->head = 0;
+    ch->tail = 0;
+    ch->count = 0;
+    ch->sent = 0;
+    ch->received = 0;
+    ch->handoffs = 0;
+    wait_queue_init(&ch->senders);
+    wait_queue_init(&ch->receivers);
+}
+
+// claim a free slot at the tail, sleeping while the ring is full
+static IpcMsg* channel_reserve(Channel* ch)
+{
+    while (ch->count == IPC_RING_SLOTS) {
+        wait_queue_sleep(&ch->senders);
+    }
+    return &ch->ring[ch->tail];
+}
+
+static void channel_commit(Channel* ch)
+{
+    ch->tail = (ch->tail + 1) % IPC_RING_SLOTS;
+    ch->count++;
+    ch->sent++;
+
+    if (wait_queue_handoff(&ch->receivers)) {
+        ch->handoffs++;
+    }
+}
+
+// copy len bytes into the ring. returns len, or -1 if it does not fit
+int channel_send(Channel* ch, const void* buf, uint32_t len)
+{
+    if (len > IPC_MSG_SIZE) {
+        return -1;
+    }
+
+    IpcMsg* msg = channel_reserve(ch);
+    msg->len = len;
+    msg->pages = NULL;
+    msg->npages = 0;
+    memcpy(msg->data, buf, len);
+    channel_commit(ch);
+    return len;
+}
+
+// hand npages pages (from page_alloc) to the receiver without copying.
+// len is the number of valid bytes in them. the sender must not touch
+// the pages afterwards.
+int channel_send_pages(Channel* ch, void* pages, int npages, uint32_t len)
+{
+    if (!pages || npages <= 0 || len > (uint32_t)npages * PAGE_SIZE) {
+        return -1;
+    }
+
+    IpcMsg* msg = channel_reserve(ch);
+    msg->len = len;
+    msg->pages = pages;
+    msg->npages = npages;
+    channel_commit(ch);
+    return len;
+}
+
+// receive one message, sleeping while the ring is empty.
+// inline data is copied to buf (up to max bytes). for a page message
+// *pages/*npages receive the ownership and buf is left alone.
+// returns the message length.
+int channel_recv(Channel* ch, void* buf, uint32_t max, void** pages, int* npages)
+{
+    while (ch->count == 0) {
+        wait_queue_sleep(&ch->receivers);
+    }
+
+    IpcMsg* msg = &ch->ring[ch->head];
+    int len = msg->len;
+
+    if (msg->pages) {
+        if (pages) *pages = msg->pages;
+        if (npages) *npages = msg->npages;
+    } else {
+        if (pages) *pages = NULL;
+        if (npages) *npages = 0;
+        memcpy(buf, msg->data, len < (int)max ? len : max);
+    }
+
+    ch->head = (ch->head + 1) % IPC_RING_SLOTS;
+    ch->count--;
+    ch->received++;
+
+    wait_queue_wake_one(&ch->senders);
+    return len;
+}
+
+
+/*
+ * PING-PONG BENCHMARK
+ * ping sends a request, pong echoes it back on a second channel.
+ * in page mode the same page is passed back and forth, which shows
+ * that the cost does not depend on the payload size.
+ */
+static Channel bench_req;
+static Channel bench_rsp;
+static Semaphore bench_done;
+static int bench_rounds;
+static int bench_pages;
+static uint32_t bench_ticks;
+static uint32_t bench_min;
+static uint32_t bench_max;
+
+static void bench_pong(void)
+{
+    uint8_t buf[IPC_MSG_SIZE];
+    void* pages;
+    int npages;
+
+    for (int i = 0; i < bench_rounds; i++) {
+        int len = channel_recv(&bench_req, buf, sizeof(buf), &pages, &npages);
+        if (len == 0 && !pages) {
+            break;   // ping never started, see ipc_bench()
+        }
+        if (pages) {
+            channel_send_pages(&bench_rsp, pages, npages, len);
+        } else {
+            channel_send(&bench_rsp, buf, len);
+        }
+    }
+    process_exit();
+}
+
+static void bench_ping(void)
+{
+    uint8_t buf[IPC_MSG_SIZE];
+    void* page = NULL;
+    int npages;
+
+    if (bench_pages) {
+        page = page_alloc(1);
+        if (!page) {
+            mini_printf("ipcbench: out of pages\n");
+        }
+    }
+    memset(buf, 0x5a, sizeof(buf));
+
+    bench_min = 0xffffffff;
+    bench_max = 0;
+    uint64_t start = read_mtime();
+    for (int i = 0; i < bench_rounds; i++) {
+        uint64_t t0 = read_mtime();
+        if (page) {
+            channel_send_pages(&bench_req, page, 1, PAGE_SIZE);
+            channel_recv(&bench_rsp, NULL, 0, &page, &npages);
+        } else {
+            channel_send(&bench_req, buf, sizeof(buf));
+            channel_recv(&bench_rsp, buf, sizeof(buf), NULL, NULL);
+        }
+        uint32_t rtt = (uint32_t)(read_mtime() - t0);
+        if (rtt < bench_min) bench_min = rtt;
+        if (rtt > bench_max) bench_max = rtt;
+    }
+    bench_ticks = (uint32_t)(read_mtime() - start);
+
+    page_free(page);
+    sem_up(&bench_done);
+    process_exit();
+}
+
+// run `rounds` request/response pairs between two fresh processes.
+// must be called from process context (e.g. the shell).
+void ipc_bench(int rounds, int use_pages)
+{
+    if (rounds <= 0) {
+        return;
+    }
+
+    channel_init(&bench_req);
+    channel_init(&bench_rsp);
+    sem_init(&bench_done, 0);
+    bench_rounds = rounds;
+    bench_pages = use_pages;
+
+    if (!CREATE_A_PROCESS(bench_pong)) {
+        return;
+    }
+    if (!CREATE_A_PROCESS(bench_ping)) {
+        // an empty message tells pong to exit instead of waiting forever
+        channel_send(&bench_req, NULL, 0);
+        return;
+    }
+    sem_down(&bench_done);
+
+    uint32_t us = ticks_to_us(bench_ticks);
+    uint32_t msgs = 2 * rounds;
+    uint32_t ns_per_tick = 1000000000 / TIMER_FREQ;
+
+    mini_printf("ipcbench: %d round-trips of %s\n", rounds,
+                use_pages ? "1 page (ownership transfer)" : "64 byte messages");
+    mini_printf("  elapsed:  %u us\n", us);
+    if (us >= 1000) {
+        mini_printf("  rate:     %u msgs/s\n", msgs * 1000 / (us / 1000));
+    }
+    mini_printf("  rtt avg:  %u ns\n", (us / rounds) * 1000 + (us % rounds) * 1000 / rounds);
+    mini_printf("  rtt min:  %u ns\n", bench_min * ns_per_tick);
+    mini_printf("  rtt max:  %u ns\n", bench_max * ns_per_tick);
+    mini_printf("  direct switches: %u of %u sends\n",
+                bench_req.handoffs + bench_rsp.handoffs, bench_req.sent + bench_rsp.sent);
+}
@@ -1,4 +1,5 @@
 #include "kernel_func.h"
+#include "mem_info.h"
 
 
 /*
@@ -60,15 +61,29 @@ void start_kernel(void)
     // EVERY MODULE YOU WRITE MUST BE INITIALIZED HERE
     // FOR EXAMPLE, TO INITIALIZE UART0, CALL THE FUNCTION uart0_init()
     uart0_init();
+    log_debug(LOG_UART, "uart0: 16550 at %p, 8N1\n", UART0);
     mini_printf("Kernel is starting...\n");
     display_welcome();
 
     init_page_allocator();
     page_test();
+    trap_init();
+    vm_init();
+    // scheduler_init() resets the process table, so everything that
+    // starts a process (irq worker, buffer cache flusher) comes after it
     scheduler_init();
-    CREATE_A_PROCESS(test_task01);
-    CREATE_A_PROCESS(test_task02);
-    CREATE_A_PROCESS(test_task03);
+    plic_init();
+    uart0_rx_init();
+    virtio_blk_init();
+    virtio_console_init();
+    bcache_init();
+    fs_init(0);
+    initramfs_init();
+    // the test tasks only print, the shell runs everything else
+    CREATE_SIZED_PROCESS(test_task01, 256 * sizeof(reg));
+    CREATE_SIZED_PROCESS(test_task02, 256 * sizeof(reg));
+    CREATE_SIZED_PROCESS(test_task03, 256 * sizeof(reg));
+    CREATE_SIZED_PROCESS(user_first_process, 4 * PAGE_SIZE);
     mini_printf("here?\n");
     scheduler();
     mini_printf("GUESS WHAT NOBODY CARES!\n");
@@ -1,6 +1,8 @@
 #pragma once
 #include "type.h"
 #include "hardware_conf.h"
+#include "riscv.h"
+#include "fs.h"
 #include <stddef.h> 
 
 
@@ -8,12 +10,94 @@
 
 // UART0 functions
 extern void uart0_init(void);
+extern void uart0_rx_init(void);
 extern void uart0_put_char(char ch);
 extern void uart0_put_string(char *s);
 extern void mini_printf(const char *fmt, ...);
+extern void uart0_write(const char *s, uint32_t len);
+typedef void (*printf_sink_t)(const char *s, uint32_t len);
+extern printf_sink_t printf_redirect(printf_sink_t out);
+extern void printf_write(const char *s, uint32_t len);
 extern void display_welcome();
 extern char uart0_get_char(void);
 extern void readline(char *buffer, int max_length);
+extern int strcmp(const char *s1, const char *s2);
+extern int strlen(const char *s);
+extern void *memcpy(void *dst, const void *src, size_t n);
+extern void *memset(void *dst, int c, size_t n);
+extern int memcmp(const void *a, const void *b, size_t n);
+
+// logging (log.c)
+// a statement is built in only if its level is at most LOG_LEVEL and
+// its subsystem is in LOG_MASK, both set by the makefile. the rest
+// compiles to nothing. log_level lowers the level at run time.
+#define LOG_NONE 0
+#define LOG_ERR 1
+#define LOG_WARN 2
+#define LOG_INFO 3
+#define LOG_DEBUG 4
+
+#define LOG_ALLOC (1 << 0)
+#define LOG_SCHED (1 << 1)
+#define LOG_UART (1 << 2)
+#define LOG_SHELL (1 << 3)
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_DEBUG
+#endif
+#ifndef LOG_MASK
+#define LOG_MASK (LOG_ALLOC | LOG_SCHED | LOG_UART)
+#endif
+
+// usable in #if as well
+#define LOG_BUILT(level, subsys) ((level) <= LOG_LEVEL && ((subsys) & LOG_MASK) != 0)
+#define LOG_ON(level, subsys) (LOG_BUILT(level, subsys) && (level) <= log_level)
+
+// messages also go to the kernel log, see dmesg
+#define LOG(level, subsys, ...) do { \
+        if (LOG_ON(level, subsys)) { \
+            reg log_intr = log_begin(); \
+            mini_printf(__VA_ARGS__); \
+            log_end(log_intr); \
+        } \
+    } while (0)
+
+#define log_err(subsys, ...) LOG(LOG_ERR, subsys, __VA_ARGS__)
+#define log_warn(subsys, ...) LOG(LOG_WARN, subsys, __VA_ARGS__)
+#define log_info(subsys, ...) LOG(LOG_INFO, subsys, __VA_ARGS__)
+#define log_debug(subsys, ...) LOG(LOG_DEBUG, subsys, __VA_ARGS__)
+
+extern int log_level;
+extern reg log_begin(void);
+extern void log_end(reg intr);
+extern int log_set_level(const char* name);
+extern void log_stat(void);
+extern void dmesg(void);
+
+// machine timer (timer.c)
+extern uint64_t read_mtime(void);
+extern uint32_t ticks_to_us(uint32_t ticks);
+extern void timer_arm(uint64_t when);
+extern void timer_disarm(void);
+extern int timer_periodic(void (*fn)(void), uint32_t period_us);
+extern uint64_t timer_periodic_next(void);
+extern void timer_periodic_run(void);
+extern uint32_t timer_lateness(void);
+
+
+// latency histograms (latency.c)
+enum {
+    LAT_WAKE_RR,               // ready -> running, cycles
+    LAT_WAKE_EDF,
+    LAT_IRQ_EXT,               // trap entry -> handler, cycles
+    LAT_IRQ_TIMER,
+    LAT_TIMER_LATE,            // timer compare -> trap, ns
+    LAT_NKINDS
+};
+
+extern void lat_record(int kind, uint32_t value);
+extern void lat_reset(void);
+extern void lat_stat(void);
 
 // memory management functions
 extern void init_page_allocator();
@@ -21,15 +105,30 @@ extern void *page_alloc(int npages);
 extern void page_free(void *p);
 extern void page_test();
 extern void page_stats();
+extern void page_bench(int rounds, int burst);
+
+// process stacks (stack.c)
+extern uint32_t stack_round(uint32_t size);
+extern void* stack_alloc(uint32_t size);
+extern void stack_free(void* stack, uint32_t size);
+extern int stack_check(void* stack);
+extern uint32_t stack_used(void* stack, uint32_t size);
+extern void stack_cache_stat(void);
 
 
 // scheduler (process aka HART management)
 extern int CREATE_A_PROCESS();
+extern int CREATE_SIZED_PROCESS(void (*s)(void), uint32_t stack_size);
+extern void stack_stat(void);
+struct UserProc;
+extern int CREATE_USER_PROCESS(void (*s)(void), struct UserProc* user);
 extern void delay(int count);
 extern void test_task01(void);
 extern void test_task02(void);
 extern void test_task03(void);
 extern void process_give_up(void);
+extern void process_exit(void);
+extern void user_first_process(void);
 extern void shell(void);
 
 
@@ -39,6 +138,70 @@ extern void shell(void);
 extern void scheduler_init(void);
 extern void scheduler(void);
 
+
+// earliest-deadline-first class (scheduler.c)
+// times are in microseconds, runtime <= deadline <= period
+#define EDF_MAX_UTIL 900           // admitted runtime/deadline sum, per mille
+
+extern int CREATE_EDF_PROCESS(void (*job)(void), uint32_t runtime, uint32_t period, uint32_t deadline,
+                              uint32_t max_jobs);
+extern void edf_timer_interrupt(void);
+extern uint32_t edf_budget_us(void);
+extern void edf_stat(void);
+
+
+// wait queues (scheduler.c)
+// a sleeping process is parked here instead of the run queue
+struct PCB;
+typedef struct WaitQueue {
+    struct PCB* head;
+    struct PCB* tail;
+    int count;
+} WaitQueue;
+
+extern void wait_queue_init(WaitQueue* q);
+extern void wait_queue_sleep(WaitQueue* q);
+extern struct PCB* wait_queue_wake_one(WaitQueue* q);
+extern int wait_queue_wake_all(WaitQueue* q);
+extern int wait_queue_handoff(WaitQueue* q);
+extern struct PCB* current_process(void);
+extern int process_is_running(struct PCB* pcb);
+extern struct UserProc* process_user(void);
+extern int process_pid(void);
+extern printf_sink_t* process_printf_sink(void);
+
+
+// sleeping locks (sync.c)
+typedef struct Mutex {
+    int locked;
+    struct PCB* owner;         // holder, NULL when unlocked
+    int spin;                  // adaptive spin budget, 0 = sleep at once
+    uint32_t contended;        // times a locker had to sleep
+    WaitQueue waiters;
+} Mutex;
+
+typedef struct Semaphore {
+    int count;
+    WaitQueue waiters;
+} Semaphore;
+
+typedef struct CondVar {
+    WaitQueue waiters;
+} CondVar;
+
+extern void mutex_init(Mutex* m, int spin);
+extern void mutex_lock(Mutex* m);
+extern int mutex_trylock(Mutex* m);
+extern void mutex_unlock(Mutex* m);
+extern void sem_init(Semaphore* s, int count);
+extern void sem_down(Semaphore* s);
+extern int sem_trydown(Semaphore* s);
+extern void sem_up(Semaphore* s);
+extern void cond_init(CondVar* cv);
+extern void cond_wait(CondVar* cv, Mutex* m);
+extern void cond_signal(CondVar* cv);
+extern void cond_broadcast(CondVar* cv);
+
 typedef struct GPRegister_context
 {
     reg ra; reg sp;
@@ -57,7 +220,203 @@ typedef struct GPRegister_context
 	reg s11; reg t3;
 	reg t4; reg t5;
 	reg t6;
+	// user processes only, see user_trap_vector in trap_vector.S
+	reg user_sp;               // sp of the user code while trapped
+	reg kernel_sp;             // kernel stack to trap onto from U-mode
 } CONTEXT;
 
 
 
+
+
+// message-passing channels (ipc.c)
+#define IPC_MSG_SIZE 64        // largest payload copied inline
+#define IPC_RING_SLOTS 8       // messages buffered per channel
+
+typedef struct IpcMsg {
+    uint32_t len;              // payload bytes
+    void* pages;               // transferred pages, NULL for inline data
+    int npages;
+    uint8_t data[IPC_MSG_SIZE];
+} IpcMsg;
+
+typedef struct Channel {
+    IpcMsg ring[IPC_RING_SLOTS];
+    int head;                  // next message to receive
+    int tail;                  // next free slot
+    int count;
+    WaitQueue senders;         // blocked on a full ring
+    WaitQueue receivers;       // blocked on an empty ring
+    uint32_t sent;
+    uint32_t received;
+    uint32_t handoffs;         // sends that switched straight to a receiver
+} Channel;
+
+extern void channel_init(Channel* ch);
+extern int channel_send(Channel* ch, const void* buf, uint32_t len);
+extern int channel_send_pages(Channel* ch, void* pages, int npages, uint32_t len);
+extern int channel_recv(Channel* ch, void* buf, uint32_t max, void** pages, int* npages);
+extern void ipc_bench(int rounds, int use_pages);
+
+
+// traps and interrupts (trap.c)
+extern void trap_init(void);
+extern void trap_handler(reg mcause, reg mepc, reg mtval, reg entry_cycle);
+
+
+// interrupt controller and bottom halves (plic.c)
+#define PLIC_NSOURCES 64
+#define PLIC_MAX_PRIORITY 7
+
+typedef void (*irq_handler_t)(int irq, void* arg);
+
+typedef struct IrqDesc {
+    irq_handler_t handler;     // top half, runs in the trap
+    void* arg;
+    const char* name;
+    int priority;
+    uint32_t count;            // interrupts handled
+    uint32_t cycles;           // total top half cycles
+    uint32_t max_cycles;
+    uint32_t bh_count;         // bottom half runs
+    uint32_t bh_cycles;
+    uint32_t bh_max_cycles;
+} IrqDesc;
+
+typedef struct Work {
+    void (*fn)(void* arg);     // bottom half, runs in the irq worker
+    void* arg;
+    int irq;                   // charged to this irq in irqstat, 0 = none
+    int pending;               // queued and not started yet
+    struct Work* next;
+} Work;
+
+extern void plic_init(void);
+extern void plic_set_priority(int irq, int priority);
+extern void plic_set_threshold(int threshold);
+extern void plic_enable(int irq);
+extern void plic_disable(int irq);
+extern void plic_dispatch(uint32_t entry_cycle);
+extern int request_irq(int irq, int priority, irq_handler_t handler, void* arg, const char* name);
+extern void free_irq(int irq);
+extern void work_init(Work* w, void (*fn)(void* arg), void* arg, int irq);
+extern void work_schedule(Work* w);
+extern void irq_stat(void);
+
+
+// virtio block device (virtio_blk.c)
+#define BLK_SECTOR_SIZE 512
+#define BLK_MAX_SEGS 8             // scatter/gather segments per request
+
+typedef struct BlkSeg {
+    void* buf;
+    uint32_t len;
+} BlkSeg;
+
+typedef struct BlkRequest {
+    uint64_t sector;           // first sector
+    int write;                 // 0 = read, 1 = write
+    int nseg;
+    BlkSeg seg[BLK_MAX_SEGS];
+    volatile int done;
+    int status;                // 0 = ok
+    void (*complete)(struct BlkRequest* req);  // optional, interrupt context
+    void* priv;                // owner's cookie for complete()
+    WaitQueue waiters;
+} BlkRequest;
+
+extern int virtio_blk_init(void);
+extern uint64_t virtio_blk_capacity(void);
+extern int virtio_blk_submit(BlkRequest* req);
+extern int virtio_blk_wait(BlkRequest* req);
+extern int virtio_blk_rw(uint64_t sector, void* buf, uint32_t len, int write);
+extern void virtio_blk_bench(int nreq, int do_write);
+
+
+// virtio console, the bulk output path (virtio_console.c)
+extern int virtio_console_init(void);
+extern int vcon_present(void);
+extern void vcon_write(const char* s, uint32_t len);
+extern void vcon_flush(void);
+extern uint32_t vcon_bytes(void);
+extern void vcon_stat(void);
+extern void vcon_bench(uint32_t kib);
+
+
+// block buffer cache (bcache.c)
+#define BLOCK_SIZE 4096            // one page per cached block
+#define NBUF 32
+
+typedef struct Buf {
+    int dev;                   // -1 while unused
+    uint32_t blockno;
+    int valid;                 // data holds the block
+    int dirty;                 // data is newer than the disk
+    int refcnt;
+    int readahead;             // fetched ahead, not read yet
+    volatile int io;           // the device owns data right now
+    Mutex lock;                // held from bread() to brelse()
+    WaitQueue io_wait;
+    uint8_t* data;
+    BlkRequest req;
+    struct Buf* hash_next;
+    struct Buf* prev;          // LRU list
+    struct Buf* next;
+} Buf;
+
+extern void bcache_init(void);
+extern Buf* bread(int dev, uint32_t blockno);
+extern void bdirty(Buf* b);
+extern int bwrite(Buf* b);
+extern void brelse(Buf* b);
+extern void bsync(void);
+extern void bcache_stat(void);
+
+
+// file system (fs.c), on-disk format in fs.h
+#define NINODE 32                  // cached inodes
+
+typedef struct Inode {
+    int dev;                   // -1 while the slot is unused
+    uint32_t inum;
+    int ref;                   // iget() references
+    int valid;                 // d has been read from disk
+    Mutex lock;                // protects d, held from ilock() to iunlock()
+    struct dinode d;
+    struct Inode* hash_next;
+} Inode;
+
+extern int fs_init(int dev);
+extern Inode* iget(int dev, uint32_t inum);
+extern void iput(Inode* ip);
+extern void ilock(Inode* ip);
+extern void iunlock(Inode* ip);
+extern Inode* namei(const char* path);
+extern Inode* fs_create(const char* path, int type);
+extern int readi(Inode* ip, void* dst, uint32_t off, uint32_t n);
+extern int writei(Inode* ip, const void* src, uint32_t off, uint32_t n);
+extern void itrunc(Inode* ip, uint32_t n);
+extern int dir_iterate(Inode* dp, void (*fn)(const char* name, int len, uint32_t inum, void* arg), void* arg);
+
+
+// user page tables (vm.c)
+typedef reg pte_t;
+
+extern void vm_init(void);
+extern pte_t* uvm_create(void);
+extern pte_t* uvm_walk(pte_t* pt, ptr va, int alloc);
+extern int uvm_map(pte_t* pt, ptr va, void* pa, int perm);
+extern void* uvm_translate(pte_t* pt, ptr va, int perm);
+extern void uvm_free(pte_t* pt);
+extern void uvm_switch(pte_t* pt);
+
+
+// initramfs archive (initramfs.c)
+extern void initramfs_init(void);
+extern const void* initramfs_find(const char* name, uint32_t* size);
+extern void initramfs_list(void);
+
+
+// ELF programs in U-mode (exec.c)
+extern int exec_program(int argc, char* argv[]);
+extern void exec_release(struct UserProc* up);
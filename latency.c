@@ -0,0 +1,99 @@
+#include "kernel_func.h"
+
+/*
+    LATENCY HISTOGRAMS
+    always on: recording a sample is a handful of shifts and adds.
+    bucket b counts samples in [2^(b-1), 2^b), bucket 0 counts 0,
+    so percentiles are exact to a power of two and max is exact.
+
+    - wake: cycles from entering a ready queue to running, per
+      scheduling class (RR, EDF), stamped in the scheduler.
+    - irq: cycles from trap entry (trap_vector.S) to the handler, per cause.
+    - timer: ns from the timer compare matching to the trap, which
+      is the only interrupt whose assert time we know exactly. it
+      includes every stretch the kernel ran with interrupts off.
+*/
+
+#define LAT_BUCKETS 33
+
+typedef struct LatHist {
+    uint32_t bucket[LAT_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+} LatHist;
+
+static LatHist lat_hist[MAX_CPU][LAT_NKINDS];
+
+static const char* lat_names[LAT_NKINDS] = {
+    "wake rr   ",
+    "wake edf  ",
+    "irq ext   ",
+    "irq timer ",
+    "timer late",
+};
+
+static const char* lat_units[LAT_NKINDS] = {
+    "cycles", "cycles", "cycles", "cycles", "ns",
+};
+
+void lat_record(int kind, uint32_t value)
+{
+    int b = 0;
+    uint32_t v = value;
+    while (v) {
+        b++;
+        v >>= 1;
+    }
+
+    reg intr = intr_off();
+    LatHist* h = &lat_hist[r_mhartid()][kind];
+    h->bucket[b]++;
+    h->count++;
+    if (value > h->max) {
+        h->max = value;
+    }
+    intr_restore(intr);
+}
+
+void lat_reset(void)
+{
+    reg intr = intr_off();
+    memset(lat_hist, 0, sizeof(lat_hist));
+    intr_restore(intr);
+}
+
+// upper bound of the bucket holding the rank-th smallest sample
+static uint32_t lat_percentile(LatHist* h, uint32_t rank)
+{
+    uint32_t seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        seen += h->bucket[b];
+        if (seen >= rank) {
+            uint32_t upper = b == 0 ? 0 : b == 32 ? 0xffffffff : (1u << b) - 1;
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+void lat_stat(void)
+{
+    int any = 0;
+    for (int hart = 0; hart < MAX_CPU; hart++) {
+        for (int kind = 0; kind < LAT_NKINDS; kind++) {
+            LatHist* h = &lat_hist[hart][kind];
+            if (!h->count) {
+                continue;
+            }
+            any = 1;
+            mini_printf("hart %d %s: %u samples, p50 <= %u, p99 <= %u, max %u %s\n",
+                        hart, lat_names[kind], h->count,
+                        lat_percentile(h, (h->count + 1) / 2),
+                        lat_percentile(h, h->count - h->count / 100),
+                        h->max, lat_units[kind]);
+        }
+    }
+    if (!any) {
+        mini_printf("no samples yet\n");
+    }
+}
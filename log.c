@@ -0,0 +1,112 @@
+#include "kernel_func.h"
+
+/*
+    LOGGING
+    the log_xxx() macros in kernel_func.h check LOG_LEVEL and LOG_MASK
+    at compile time, so a production build (make LOG_LEVEL=WARN) has
+    no calls, no format strings and no branches for debug output in
+    the scheduler or the allocator. log_level only filters among the
+    statements that were built in.
+
+    every message is also kept in the kernel log, a ring of the last
+    DMESG_SIZE bytes, which dmesg prints again. `bulk dmesg` streams it
+    out through the virtio console.
+*/
+
+#define DMESG_SIZE (16 * 1024)
+
+int log_level = LOG_LEVEL;
+
+static char dmesg_buf[DMESG_SIZE];
+static uint32_t dmesg_len;             // bytes ever logged
+static printf_sink_t log_out;          // the caller's sink, log_begin() to log_end()
+static uint32_t log_start;             // dmesg_len at log_begin()
+
+static void dmesg_out(const char* s, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        dmesg_buf[(dmesg_len + i) % DMESG_SIZE] = s[i];
+    }
+    dmesg_len += len;
+}
+
+// print the kernel log from byte `from` on, as far as it is kept
+static void dmesg_write(uint32_t from)
+{
+    if (dmesg_len - from > DMESG_SIZE) {
+        from = dmesg_len - DMESG_SIZE;
+    }
+    uint32_t i = from % DMESG_SIZE;
+    uint32_t n = dmesg_len - from;
+
+    if (i + n > DMESG_SIZE) {
+        printf_write(dmesg_buf + i, DMESG_SIZE - i);
+        n -= DMESG_SIZE - i;
+        i = 0;
+    }
+    printf_write(dmesg_buf + i, n);
+}
+
+// mini_printf output goes to the kernel log only until log_end().
+// interrupts are off and nothing in between sleeps, so log_out and
+// log_start belong to one message at a time.
+reg log_begin(void)
+{
+    reg intr = intr_off();
+    log_start = dmesg_len;
+    log_out = printf_redirect(dmesg_out);
+    return intr;
+}
+
+// then the message goes where the caller's output goes. that may
+// sleep (a full virtio console), so take the state along first.
+void log_end(reg intr)
+{
+    uint32_t start = log_start;
+    printf_redirect(log_out);
+    dmesg_write(start);
+    intr_restore(intr);
+}
+
+// print the kernel log, oldest first
+void dmesg(void)
+{
+    dmesg_write(dmesg_len > DMESG_SIZE ? dmesg_len - DMESG_SIZE : 0);
+}
+
+static const char* log_level_names[] = { "none", "err", "warn", "info", "debug" };
+
+static const char* log_subsys_names[] = { "alloc", "sched", "uart", "shell" };
+
+// set the run-time level by name or number, -1 if it is not built in
+int log_set_level(const char* name)
+{
+    int level = -1;
+    for (int i = LOG_NONE; i <= LOG_DEBUG; i++) {
+        if (strcmp(name, log_level_names[i]) == 0) {
+            level = i;
+        }
+    }
+    if (level < 0 && name[0] >= '0' && name[0] <= '9' && name[1] == '\0') {
+        level = name[0] - '0';
+    }
+    if (level < LOG_NONE || level > LOG_LEVEL) {
+        return -1;
+    }
+    log_level = level;
+    return level;
+}
+
+void log_stat(void)
+{
+    mini_printf("log level %s (%d), built up to %s (%d)\n",
+                log_level_names[log_level], log_level,
+                log_level_names[LOG_LEVEL], LOG_LEVEL);
+    mini_printf("subsystems built in:");
+    for (int i = 0; i < 4; i++) {
+        if (LOG_MASK & (1 << i)) {
+            mini_printf(" %s", log_subsys_names[i]);
+        }
+    }
+    mini_printf("\n");
+}
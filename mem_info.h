@@ -4,6 +4,7 @@
 #define PAGE_SIZE 4096
 #define PAGE_IS_USED (uint8_t)(1 << 0) // 00000001 in binary means the page is used
 #define PAGE_IS_LAST (uint8_t)(1 << 1) // 00000010 in binary means the page is the last page in a contiguous allocation
+#define PAGE_IN_MAG (uint8_t)(1 << 2)  // a free single page cached in a magazine (page_alloc.c)
 typedef struct Page {
     uint8_t flags;
 } Page;
@@ -0,0 +1,186 @@
+/*
+    mkfs: build a SuepOS file system image on the host.
+
+    usage: mkfs/mkfs fs.img [-b blocks] [-i inodes] [-n count] [files...]
+
+    every file is copied into the root directory under its base name,
+    as one contiguous extent. -n adds `count` empty files f00000,
+    f00001, ... to get a directory big enough to measure lookups on.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../fs.h"
+
+static uint8_t* img;
+static struct superblock sb;
+static uint32_t next_block;          // first unused data block
+static uint32_t next_inum = ROOT_INUM;
+
+static void die(const char* msg)
+{
+    fprintf(stderr, "mkfs: %s\n", msg);
+    exit(1);
+}
+
+static uint8_t* block(uint32_t b)
+{
+    return img + (size_t)b * FS_BLOCK_SIZE;
+}
+
+static struct dinode* dinode(uint32_t inum)
+{
+    return (struct dinode*)block(sb.inode_start + inum / IPB) + inum % IPB;
+}
+
+static uint32_t alloc_blocks(uint32_t n)
+{
+    if (next_block + n > sb.size) die("image too small");
+    uint32_t start = next_block;
+    next_block += n;
+    return start;
+}
+
+static uint32_t alloc_inode(int type)
+{
+    if (next_inum >= sb.ninodes) die("out of inodes");
+    struct dinode* d = dinode(next_inum);
+    d->type = type;
+    d->nlink = 1;
+    return next_inum++;
+}
+
+// same probing as bucket_insert() in fs.c
+static void dir_insert(struct dinode* dp, const char* name, uint32_t inum)
+{
+    int len = strlen(name);
+    uint32_t nb = dp->size / FS_BLOCK_SIZE;
+    uint32_t home = fs_name_hash(name, len) % nb;
+
+    for (uint32_t probe = 0; probe < nb; probe++) {
+        struct dirbucket* bucket = (struct dirbucket*)block(dp->ext[0].start + (home + probe) % nb);
+        if (bucket->hdr.count < DIRENTS_PER_BUCKET) {
+            for (unsigned i = 0; i < DIRENTS_PER_BUCKET; i++) {
+                struct dirent* de = &bucket->ent[i];
+                if (de->inum == 0) {
+                    de->inum = inum;
+                    de->name_len = len;
+                    memcpy(de->name, name, len);
+                    bucket->hdr.count++;
+                    dp->nentries++;
+                    return;
+                }
+            }
+        }
+        bucket->hdr.overflow = 1;
+    }
+    die("directory full");
+}
+
+static uint32_t add_file(const char* path, const char** name)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) die(path);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint32_t inum = alloc_inode(T_FILE);
+    struct dinode* d = dinode(inum);
+    uint32_t nblocks = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    if (nblocks) {
+        d->ext[0].start = alloc_blocks(nblocks);
+        d->ext[0].len = nblocks;
+        d->nextents = 1;
+        if (fread(block(d->ext[0].start), 1, size, f) != (size_t)size) die(path);
+    }
+    d->size = size;
+    fclose(f);
+
+    const char* slash = strrchr(path, '/');
+    *name = slash ? slash + 1 : path;
+    if (strlen(*name) > FS_NAME_LEN) die("file name too long");
+    return inum;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t nblocks = 8192;         // 32 MiB
+    uint32_t ninodes = 1024;
+    int nempty = 0;
+    const char* files[256];
+    int nfiles = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: mkfs fs.img [-b blocks] [-i inodes] [-n count] [files...]\n");
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            nblocks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            ninodes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            nempty = atoi(argv[++i]);
+        } else if (nfiles < 256) {
+            files[nfiles++] = argv[i];
+        }
+    }
+    if (ninodes < (uint32_t)(nfiles + nempty + 2)) {
+        ninodes = nfiles + nempty + 2;
+    }
+
+    sb.magic = FS_MAGIC;
+    sb.size = nblocks;
+    sb.ninodes = ninodes;
+    sb.inode_start = FS_SUPER_BLOCK + 1;
+    sb.ninode_blocks = (ninodes + IPB - 1) / IPB;
+    sb.bmap_start = sb.inode_start + sb.ninode_blocks;
+    sb.nbmap_blocks = (nblocks + BPB - 1) / BPB;
+    sb.data_start = sb.bmap_start + sb.nbmap_blocks;
+    if (sb.data_start >= nblocks) die("image too small");
+
+    img = calloc(nblocks, FS_BLOCK_SIZE);
+    if (!img) die("out of memory");
+    memcpy(block(FS_SUPER_BLOCK), &sb, sizeof(sb));
+    next_block = sb.data_start;
+
+    // root directory, with enough buckets to stay under DIR_MAX_LOAD
+    uint32_t root = alloc_inode(T_DIR);
+    struct dinode* rp = dinode(root);
+    uint32_t nentries = nfiles + nempty;
+    uint32_t nb = 1;
+    while (nentries * 100 > nb * DIRENTS_PER_BUCKET * DIR_MAX_LOAD) {
+        nb *= 2;
+    }
+    rp->ext[0].start = alloc_blocks(nb);
+    rp->ext[0].len = nb;
+    rp->nextents = 1;
+    rp->size = nb * FS_BLOCK_SIZE;
+
+    for (int i = 0; i < nfiles; i++) {
+        const char* name;
+        uint32_t inum = add_file(files[i], &name);
+        dir_insert(dinode(root), name, inum);
+    }
+    for (int i = 0; i < nempty; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%05d", i);
+        dir_insert(dinode(root), name, alloc_inode(T_FILE));
+    }
+
+    // everything up to next_block is in use
+    for (uint32_t b = 0; b < next_block; b++) {
+        block(sb.bmap_start + b / BPB)[(b % BPB) / 8] |= 1 << (b % 8);
+    }
+
+    FILE* out = fopen(argv[1], "wb");
+    if (!out) die(argv[1]);
+    if (fwrite(img, FS_BLOCK_SIZE, nblocks, out) != nblocks) die("write failed");
+    fclose(out);
+
+    printf("mkfs: %s: %u blocks, %u inodes, %d files, root has %u buckets\n",
+           argv[1], nblocks, ninodes, nfiles + nempty, nb);
+    return 0;
+}
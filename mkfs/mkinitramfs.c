@@ -0,0 +1,102 @@
+/*
+    mkinitramfs: build the initramfs archive on the host.
+
+    usage: mkfs/mkinitramfs out.cpio [files...]
+
+    writes a cpio archive in "newc" format, the one initramfs.c reads,
+    with every file under its base name. before a file whose data
+    would not start on a page boundary, an entry named .pad is added
+    whose data fills the gap; the kernel skips those. linked in on a
+    page boundary, every file then starts on its own page, and exec
+    can map program code in place.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_SIZE 4096
+#define HDR_SIZE 110
+
+static FILE* out;
+static unsigned long offset;         // bytes written so far
+
+static void die(const char* msg, const char* arg)
+{
+    fprintf(stderr, "mkinitramfs: %s%s\n", msg, arg ? arg : "");
+    exit(1);
+}
+
+static unsigned long align4(unsigned long n)
+{
+    return (n + 3) & ~3UL;
+}
+
+static void put(const void* p, unsigned long n)
+{
+    if (n && fwrite(p, 1, n, out) != n) die("write failed", NULL);
+    offset += n;
+}
+
+static void pad4(void)
+{
+    static const char zero[4];
+    put(zero, align4(offset) - offset);
+}
+
+static void entry(const char* name, const void* data, unsigned long size, int mode)
+{
+    static unsigned ino = 1;
+    char hdr[128];
+    unsigned long namesize = strlen(name) + 1;
+
+    snprintf(hdr, sizeof(hdr),
+             "070701%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+             ino++, mode, 0, 0, 1, 0, (unsigned)size, 0, 0, 0, 0, (unsigned)namesize, 0);
+    put(hdr, HDR_SIZE);
+    put(name, namesize);
+    pad4();
+    put(data, size);
+    pad4();
+}
+
+// make the data of the next entry, named `name`, start on a page
+static void align_next(const char* name)
+{
+    unsigned long pad_hdr = align4(HDR_SIZE + sizeof(".pad"));
+    unsigned long hdr = align4(HDR_SIZE + strlen(name) + 1);
+    if ((offset + hdr) % PAGE_SIZE == 0) {
+        return;
+    }
+    unsigned long fill = (PAGE_SIZE - (offset + pad_hdr + hdr) % PAGE_SIZE) % PAGE_SIZE;
+    static char zero[PAGE_SIZE];
+    entry(".pad", zero, fill, 0100644);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) die("usage: mkinitramfs out.cpio [files...]", NULL);
+    out = fopen(argv[1], "wb");
+    if (!out) die("cannot create ", argv[1]);
+
+    for (int i = 2; i < argc; i++) {
+        FILE* f = fopen(argv[i], "rb");
+        if (!f) die("cannot open ", argv[i]);
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        char* data = malloc(size ? size : 1);
+        if (!data || fread(data, 1, size, f) != (size_t)size) die("cannot read ", argv[i]);
+        fclose(f);
+        if (size > 0x7fffffffL) die("too big: ", argv[i]);
+
+        const char* name = strrchr(argv[i], '/');
+        name = name ? name + 1 : argv[i];
+        align_next(name);
+        entry(name, data, size, 0100755);
+        free(data);
+    }
+    entry("TRAILER!!!", NULL, 0, 0);
+
+    fclose(out);
+    return 0;
+}
@@ -25,14 +25,14 @@ static inline ptr align_page(ptr addr) {
 // initialize the page allocator, 
 // it will do initialization work.
 void init_page_allocator() {
-    mini_printf("Initializing page allocator...\n");
+    log_info(LOG_ALLOC, "Initializing page allocator...\n");
     
     ptr heap_start_aligned = align_page((ptr)HEAP_ENTRY);
     uint32_t available_heap_size = HEAP_END - heap_start_aligned;
     
-    mini_printf("Heap start: %x\n", HEAP_ENTRY);
-    mini_printf("Heap end: %x\n", HEAP_END);
-    mini_printf("Available heap size: %d bytes\n", available_heap_size);
+    log_debug(LOG_ALLOC, "Heap start: %x\n", HEAP_ENTRY);
+    log_debug(LOG_ALLOC, "Heap end: %x\n", HEAP_END);
+    log_debug(LOG_ALLOC, "Available heap size: %d bytes\n", available_heap_size);
 
 
 
@@ -40,11 +40,11 @@ void init_page_allocator() {
     // Calculate the size needed for page descriptors:
     uint32_t page_descriptor_size = (available_heap_size / PAGE_SIZE) * sizeof(struct Page);
     uint32_t num_reserved_pages = (page_descriptor_size + PAGE_SIZE - 1) / PAGE_SIZE;
-    mini_printf("Reserving %d pages for page descriptors (%d bytes)\n", num_reserved_pages, page_descriptor_size);
+    log_debug(LOG_ALLOC, "Reserving %d pages for page descriptors (%d bytes)\n", num_reserved_pages, page_descriptor_size);
     
     // Calculate the number of pages available for allocation after reserving space for page descriptors
     ALLOCATE_PAGES = (available_heap_size - num_reserved_pages * PAGE_SIZE) / PAGE_SIZE;
-    mini_printf("Total available pages for allocation: %d\n", ALLOCATE_PAGES);
+    log_info(LOG_ALLOC, "Total available pages for allocation: %d\n", ALLOCATE_PAGES);
 
     // Initialize ALL page descriptors (including those used for the descriptors themselves)
     uint32_t total_pages = available_heap_size / PAGE_SIZE;
@@ -62,23 +62,23 @@ void init_page_allocator() {
     ALLOCATE_START = heap_start_aligned + num_reserved_pages * PAGE_SIZE;
     ALLOCATE_END = ALLOCATE_START + ALLOCATE_PAGES * PAGE_SIZE;
     
-    mini_printf("Debug - TEXT_ENTRY: %p\n", TEXT_ENTRY);
-    mini_printf("Debug - TEXT_END: %p\n", TEXT_END);
-    mini_printf("Debug - HEAP_ENTRY: %p\n", HEAP_ENTRY);
-    mini_printf("Debug - HEAP_END: %p\n", HEAP_END);
+    log_debug(LOG_ALLOC, "Debug - TEXT_ENTRY: %p\n", TEXT_ENTRY);
+    log_debug(LOG_ALLOC, "Debug - TEXT_END: %p\n", TEXT_END);
+    log_debug(LOG_ALLOC, "Debug - HEAP_ENTRY: %p\n", HEAP_ENTRY);
+    log_debug(LOG_ALLOC, "Debug - HEAP_END: %p\n", HEAP_END);
 
-    mini_printf("TEXT:    0x%x -> 0x%x\n", TEXT_ENTRY, (uint32_t)TEXT_END);
-    mini_printf("RODATA:  0x%x -> 0x%x\n", RODATA_ENTRY, (uint32_t)RODATA_END);
-    mini_printf("DATA:    0x%x -> 0x%x\n", (uint32_t)DATA_ENTRY, (uint32_t)DATA_END);
-    mini_printf("BSS:     0x%x -> 0x%x\n", (uint32_t)BSS_ENTRY, (uint32_t)BSS_END);
-    mini_printf("HEAP:    0x%x -> 0x%x\n", (uint32_t)HEAP_ENTRY, (uint32_t)HEAP_END);
+    log_debug(LOG_ALLOC, "TEXT:    0x%x -> 0x%x\n", TEXT_ENTRY, (uint32_t)TEXT_END);
+    log_debug(LOG_ALLOC, "RODATA:  0x%x -> 0x%x\n", RODATA_ENTRY, (uint32_t)RODATA_END);
+    log_debug(LOG_ALLOC, "DATA:    0x%x -> 0x%x\n", (uint32_t)DATA_ENTRY, (uint32_t)DATA_END);
+    log_debug(LOG_ALLOC, "BSS:     0x%x -> 0x%x\n", (uint32_t)BSS_ENTRY, (uint32_t)BSS_END);
+    log_debug(LOG_ALLOC, "HEAP:    0x%x -> 0x%x\n", (uint32_t)HEAP_ENTRY, (uint32_t)HEAP_END);
 
 
-    mini_printf("Page allocator initialized.\n");
+    log_info(LOG_ALLOC, "Page allocator initialized.\n");
 }
 
 /*a simple method to allocate pages*/
-void *page_alloc(int npages)
+static void *global_alloc(int npages)
 {
     if (npages <= 0 || npages > ALLOCATE_PAGES) {
         return NULL;
@@ -114,48 +114,232 @@ void *page_alloc(int npages)
     return NULL; /* no enough pages */
 }
 
-// free the pages starting from pointer p
-void page_free(void *p)
+// free the pages starting from descriptor start_index
+static void global_free(int start_index)
 {
-    if (!p || (ptr)p < ALLOCATE_START || (ptr)p >= ALLOCATE_END) {
-        return;
-    }
-    
-    int start_index = ((ptr)p - ALLOCATE_START) / PAGE_SIZE;
     struct Page *page = (struct Page *)HEAP_ENTRY;
     
     /* free the continuous pages */
     int i = start_index;
     while (i < ALLOCATE_PAGES && !page_is_available(&page[i])) {
+        // check before clearing, page_clear drops the last flag too
+        int last = page_is_last(&page[i]);
         page_clear(&page[i]);
-        if (page_is_last(&page[i])) {
+        if (last) {
             break;
         }
         i++;
     }
 }
 
+
+/*
+    PAGE MAGAZINES
+    single pages come and go all the time (stacks, page tables,
+    buffers), so each hart keeps a LIFO magazine of free pages in
+    front of the descriptor array. page_alloc(1) pops the page freed
+    last, which is likely still in the cache, and page_free() of a
+    single page pushes it: no scan, and nothing shared between harts.
+    pages in a magazine stay marked used in their descriptors, the
+    global allocator never sees them. PAGE_IN_MAG marks them too, so
+    freeing such a page again is caught instead of caching it twice.
+    - empty magazine: one scan refills MAG_BATCH pages.
+    - full magazine (MAG_SIZE): MAG_BATCH pages go back at once.
+    - a multi-page request that does not fit: every magazine goes
+      back and the scan is retried (the kernel runs one hart, so
+      emptying the other magazines from here is safe).
+    so a hart goes to the descriptor array once per MAG_BATCH
+    single-page operations at most.
+*/
+#define MAG_SIZE 32
+#define MAG_BATCH 16
+
+typedef struct Magazine {
+    void *page[MAG_SIZE];
+    int count;
+    uint32_t alloc_hits;
+    uint32_t alloc_misses;     // had to refill first
+    uint32_t frees;
+    uint32_t refills;
+    uint32_t drains;           // full on free, MAG_BATCH pages given back
+    uint32_t flushes;          // emptied for a multi-page request
+} Magazine;
+
+static Magazine magazines[MAX_CPU];
+
+static void mag_refill(Magazine *m)
+{
+    struct Page *page = (struct Page *)HEAP_ENTRY;
+    for (int i = 0; i < ALLOCATE_PAGES && m->count < MAG_BATCH; i++) {
+        if (page_is_available(&page[i])) {
+            page_set_flag(&page[i], PAGE_IS_USED | PAGE_IS_LAST | PAGE_IN_MAG);
+            m->page[m->count++] = (void *)(ALLOCATE_START + i * PAGE_SIZE);
+        }
+    }
+    m->refills++;
+}
+
+// give back up to n pages
+static void mag_drain(Magazine *m, int n)
+{
+    struct Page *page = (struct Page *)HEAP_ENTRY;
+    while (n-- > 0 && m->count > 0) {
+        ptr p = (ptr)m->page[--m->count];
+        page_clear(&page[(p - ALLOCATE_START) / PAGE_SIZE]);
+    }
+}
+
+void *page_alloc(int npages)
+{
+    if (npages != 1) {
+        reg intr = intr_off();
+        void *p = global_alloc(npages);
+        if (!p) {
+            // the free pages may be sitting in magazines
+            for (int hart = 0; hart < MAX_CPU; hart++) {
+                if (magazines[hart].count) {
+                    mag_drain(&magazines[hart], MAG_SIZE);
+                    magazines[hart].flushes++;
+                }
+            }
+            p = global_alloc(npages);
+        }
+        intr_restore(intr);
+        return p;
+    }
+
+    struct Page *page = (struct Page *)HEAP_ENTRY;
+    reg intr = intr_off();
+    Magazine *m = &magazines[r_mhartid()];
+    if (m->count) {
+        m->alloc_hits++;
+    } else {
+        m->alloc_misses++;
+        mag_refill(m);
+    }
+    void *p = NULL;
+    if (m->count) {
+        p = m->page[--m->count];
+        page[((ptr)p - ALLOCATE_START) / PAGE_SIZE].flags &= ~PAGE_IN_MAG;
+    }
+    intr_restore(intr);
+    return p;
+}
+
+// free the pages starting from pointer p
+void page_free(void *p)
+{
+    if (!p || (ptr)p < ALLOCATE_START || (ptr)p >= ALLOCATE_END) {
+        return;
+    }
+    
+    int start_index = ((ptr)p - ALLOCATE_START) / PAGE_SIZE;
+    struct Page *page = (struct Page *)HEAP_ENTRY;
+
+    reg intr = intr_off();
+    if (page_is_available(&page[start_index])) {
+        // not allocated
+    } else if (page[start_index].flags & PAGE_IN_MAG) {
+        log_warn(LOG_ALLOC, "page_free: %p freed twice\n", p);
+    } else if (page_is_last(&page[start_index])) {
+        // a single page
+        Magazine *m = &magazines[r_mhartid()];
+        if (m->count == MAG_SIZE) {
+            mag_drain(m, MAG_BATCH);
+            m->drains++;
+        }
+        page_set_flag(&page[start_index], PAGE_IN_MAG);
+        m->page[m->count++] = p;
+        m->frees++;
+    } else {
+        global_free(start_index);
+    }
+    intr_restore(intr);
+}
+
+void page_stats()
+{
+    struct Page *page = (struct Page *)HEAP_ENTRY;
+    int free = 0;
+    int cached = 0;
+    for (int i = 0; i < ALLOCATE_PAGES; i++) {
+        free += page_is_available(&page[i]);
+    }
+    for (int hart = 0; hart < MAX_CPU; hart++) {
+        cached += magazines[hart].count;
+    }
+    mini_printf("pages: %d free, %d in magazines, %d total\n", free, cached, ALLOCATE_PAGES);
+
+    for (int hart = 0; hart < MAX_CPU; hart++) {
+        Magazine *m = &magazines[hart];
+        uint32_t allocs = m->alloc_hits + m->alloc_misses;
+        if (!allocs && !m->frees) {
+            continue;
+        }
+        mini_printf("hart %d magazine: %d pages, %u allocs, %u%% hits, %u frees\n",
+                    hart, m->count, allocs, allocs ? m->alloc_hits * 100 / allocs : 0, m->frees);
+        mini_printf("  %u refills, %u drains of %d pages, %u flushes\n",
+                    m->refills, m->drains, MAG_BATCH, m->flushes);
+    }
+}
+
+// cycles per single-page alloc/free, in bursts of `burst` allocations
+// and then as many frees, through the magazine and straight through
+// the descriptor array
+void page_bench(int rounds, int burst)
+{
+    void *pages[MAG_SIZE * 2];
+    if (burst > MAG_SIZE * 2) {
+        burst = MAG_SIZE * 2;
+    }
+    if (rounds <= 0 || burst <= 0) {
+        return;
+    }
+
+    for (int global = 0; global < 2; global++) {
+        uint32_t start = r_cycle();
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < burst; i++) {
+                pages[i] = global ? global_alloc(1) : page_alloc(1);
+            }
+            for (int i = burst - 1; i >= 0; i--) {
+                if (!pages[i]) {
+                    continue;
+                } else if (global) {
+                    global_free(((ptr)pages[i] - ALLOCATE_START) / PAGE_SIZE);
+                } else {
+                    page_free(pages[i]);
+                }
+            }
+        }
+        uint32_t cycles = r_cycle() - start;
+        mini_printf("  %s: %u cycles per alloc + free\n",
+                    global ? "descriptor array" : "magazine        ",
+                    cycles / (rounds * burst));
+    }
+}
+
 // simple test function for page allocation
 void page_test()
 {
-    mini_printf("=== Page Allocation Test ===\n");
+    log_debug(LOG_ALLOC, "=== Page Allocation Test ===\n");
     
     void *p1 = page_alloc(2); // parameter 2 means allocate 2 pages
-    mini_printf("Allocated 2 pages at: %p\n", p1);
+    log_debug(LOG_ALLOC, "Allocated 2 pages at: %p\n", p1);
     
     void *p2 = page_alloc(3);
-    mini_printf("Allocated 3 pages at: %p\n", p2);
+    log_debug(LOG_ALLOC, "Allocated 3 pages at: %p\n", p2);
     
     void *p3 = page_alloc(1);
-    mini_printf("Allocated 1 page at: %p\n", p3);
+    log_debug(LOG_ALLOC, "Allocated 1 page at: %p\n", p3);
     
-    mini_printf("Freeing p2...\n");
+    log_debug(LOG_ALLOC, "Freeing p2...\n");
     page_free(p2);
     
     void *p4 = page_alloc(4);
-    mini_printf("Allocated 4 pages at: %p\n", p4);
+    log_debug(LOG_ALLOC, "Allocated 4 pages at: %p\n", p4);
     
-    mini_printf("=== Test Completed ===\n");
+    log_debug(LOG_ALLOC, "=== Test Completed ===\n");
     page_free(p1);
     page_free(p3);
     page_free(p4);
@@ -0,0 +1,216 @@
+#include "kernel_func.h"
+
+/*
+    PLIC, platform-level interrupt controller
+    every device interrupt goes through here, in two halves:
+
+    - top half: the handler a driver registered with request_irq().
+      it runs in the trap with interrupts off, so it only acks the
+      device and hands the rest over with work_schedule().
+    - bottom half: a Work item, run later by the irq worker process
+      with interrupts on. the trap returns as soon as the top half
+      is done, whatever the driver has to do afterwards.
+
+    a source only interrupts the hart if its priority is above the
+    hart's threshold, so raising the threshold masks every source at
+    or below it at once (plic_set_threshold).
+*/
+
+static IrqDesc irq_desc[PLIC_NSOURCES];
+
+// pending bottom halves, filled by top halves, drained by irq_worker
+static Work* work_head;
+static Work* work_tail;
+static WaitQueue work_wait;
+
+void plic_set_priority(int irq, int priority)
+{
+    *(volatile uint32_t *)PLIC_PRIORITY(irq) = priority;
+    irq_desc[irq].priority = priority;
+}
+
+void plic_set_threshold(int threshold)
+{
+    *(volatile uint32_t *)PLIC_MTHRESHOLD(r_mhartid()) = threshold;
+}
+
+void plic_enable(int irq)
+{
+    volatile uint32_t* enable = (volatile uint32_t *)PLIC_MENABLE(r_mhartid());
+    enable[irq / 32] |= 1 << (irq % 32);
+}
+
+void plic_disable(int irq)
+{
+    volatile uint32_t* enable = (volatile uint32_t *)PLIC_MENABLE(r_mhartid());
+    enable[irq / 32] &= ~(1 << (irq % 32));
+}
+
+static int plic_claim(void)
+{
+    return *(volatile uint32_t *)PLIC_MCLAIM(r_mhartid());
+}
+
+static void plic_complete(int irq)
+{
+    *(volatile uint32_t *)PLIC_MCLAIM(r_mhartid()) = irq;
+}
+
+// route irq to handler(irq, arg) and unmask it.
+// priority 1 (lowest) .. PLIC_MAX_PRIORITY, 0 would never fire.
+int request_irq(int irq, int priority, irq_handler_t handler, void* arg, const char* name)
+{
+    if (irq <= 0 || irq >= PLIC_NSOURCES || !handler ||
+        priority < 1 || priority > PLIC_MAX_PRIORITY) {
+        return -1;
+    }
+    IrqDesc* d = &irq_desc[irq];
+    if (d->handler) {
+        return -1;   // sources are not shared on virt
+    }
+    d->handler = handler;
+    d->arg = arg;
+    d->name = name;
+    plic_set_priority(irq, priority);
+    plic_enable(irq);
+    return 0;
+}
+
+void free_irq(int irq)
+{
+    if (irq <= 0 || irq >= PLIC_NSOURCES) {
+        return;
+    }
+    plic_disable(irq);
+    plic_set_priority(irq, 0);
+    irq_desc[irq].handler = NULL;
+}
+
+// called from trap_handler() for a machine external interrupt
+void plic_dispatch(uint32_t entry_cycle)
+{
+    int irq = plic_claim();
+    if (irq == 0) {
+        return;  // claimed by someone else already
+    }
+
+    IrqDesc* d = irq < PLIC_NSOURCES ? &irq_desc[irq] : NULL;
+    if (d && d->handler) {
+        uint32_t start = r_cycle();
+        lat_record(LAT_IRQ_EXT, start - entry_cycle);
+        d->handler(irq, d->arg);
+        uint32_t cycles = r_cycle() - start;
+        d->count++;
+        d->cycles += cycles;
+        if (cycles > d->max_cycles) {
+            d->max_cycles = cycles;
+        }
+    } else {
+        mini_printf("unexpected irq %d\n", irq);
+    }
+    plic_complete(irq);
+}
+
+
+/*
+    BOTTOM HALVES
+    a Work item is queued at most once: scheduling it again before
+    it ran is a no-op, the bottom half then handles both events.
+*/
+void work_init(Work* w, void (*fn)(void* arg), void* arg, int irq)
+{
+    w->fn = fn;
+    w->arg = arg;
+    w->irq = irq;
+    w->pending = 0;
+    w->next = NULL;
+}
+
+// safe from top halves and from processes
+void work_schedule(Work* w)
+{
+    reg intr = intr_off();
+    if (!w->pending) {
+        w->pending = 1;
+        w->next = NULL;
+        if (work_tail) {
+            work_tail->next = w;
+        } else {
+            work_head = w;
+        }
+        work_tail = w;
+        wait_queue_wake_one(&work_wait);
+    }
+    intr_restore(intr);
+}
+
+static Work* work_pop(void)
+{
+    reg intr = intr_off();
+    Work* w = work_head;
+    if (w) {
+        work_head = w->next;
+        if (!work_head) {
+            work_tail = NULL;
+        }
+        w->next = NULL;
+        w->pending = 0;   // may be scheduled again while fn runs
+    }
+    intr_restore(intr);
+    return w;
+}
+
+static void irq_worker(void)
+{
+    while (1) {
+        Work* w;
+        while ((w = work_pop()) != NULL) {
+            uint32_t start = r_cycle();
+            w->fn(w->arg);
+            uint32_t cycles = r_cycle() - start;
+
+            if (w->irq > 0 && w->irq < PLIC_NSOURCES) {
+                IrqDesc* d = &irq_desc[w->irq];
+                d->bh_count++;
+                d->bh_cycles += cycles;
+                if (cycles > d->bh_max_cycles) {
+                    d->bh_max_cycles = cycles;
+                }
+            }
+        }
+
+        reg intr = intr_off();
+        if (!work_head) {
+            wait_queue_sleep(&work_wait);
+        }
+        intr_restore(intr);
+    }
+}
+
+void plic_init(void)
+{
+    for (int irq = 1; irq < PLIC_NSOURCES; irq++) {
+        plic_set_priority(irq, 0);
+        plic_disable(irq);
+    }
+    plic_set_threshold(0);
+    wait_queue_init(&work_wait);
+    CREATE_A_PROCESS(irq_worker);
+}
+
+void irq_stat(void)
+{
+    for (int irq = 1; irq < PLIC_NSOURCES; irq++) {
+        IrqDesc* d = &irq_desc[irq];
+        if (!d->handler && !d->count) {
+            continue;
+        }
+        mini_printf("irq %d %s (priority %d): %u interrupts\n",
+                    irq, d->name ? d->name : "?", d->priority, d->count);
+        mini_printf("  top half:    avg %u, max %u cycles\n",
+                    d->count ? d->cycles / d->count : 0, d->max_cycles);
+        mini_printf("  bottom half: %u runs, avg %u, max %u cycles\n",
+                    d->bh_count, d->bh_count ? d->bh_cycles / d->bh_count : 0,
+                    d->bh_max_cycles);
+    }
+}
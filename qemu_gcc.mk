@@ -9,29 +9,70 @@ endif
 
 DEFS += -D__MEMORY_S__
 
+# logging (log.c): LOG_LEVEL is the most verbose level built in, one of
+# NONE ERR WARN INFO DEBUG, and LOG_SUBSYS the subsystems whose messages
+# are built in. everything else compiles to nothing, so
+# make LOG_LEVEL=WARN gives a kernel without debug output on hot paths
+# (make clean first, objects do not depend on these settings).
+# SHELL (a timing line after every command) is left out by default,
+# add it with make LOG_SUBSYS="ALLOC SCHED UART SHELL".
+LOG_LEVEL ?= DEBUG
+LOG_SUBSYS ?= ALLOC SCHED UART
+DEFS += -DLOG_LEVEL=LOG_${LOG_LEVEL}
+DEFS += -DLOG_MASK='($(patsubst %,LOG_%|,${LOG_SUBSYS})0)'
+
 CROSS_COMPILE = riscv64-unknown-elf-
 CFLAGS += -nostdlib -fno-builtin -g -Wall
-CFLAGS += -march=rv32g -mabi=ilp32
 CFLAGS += -Xlinker --defsym=__MEM_SIZE__=0x4000000  # 64MB
 
-
+# target: make ARCH=rv64 run for the 64-bit kernel, rv32 by default.
+# medany lets rv64 code live at 0x80000000, above the low 2 GiB.
+ARCH ?= rv32
+ifeq (${ARCH}, rv64)
+ARCHFLAGS = -march=rv64g -mabi=lp64 -mcmodel=medany
+QEMU = qemu-system-riscv64
+OUTPUT_PATH = kernel-rv64
+else
+ARCHFLAGS = -march=rv32g -mabi=ilp32
 QEMU = qemu-system-riscv32
+OUTPUT_PATH = kernel
+endif
+CFLAGS += ${ARCHFLAGS}
+
 QFLAGS = -smp 1 -machine virt -bios none -device virtio-gpu-device
 QFLAGS-nographic = -nographic -smp 1 -machine virt -bios none
 
+# optional virtio-blk disk: make run DISK=disk.img
+ifneq (${DISK},)
+QFLAGS-nographic += -drive file=${DISK},if=none,format=raw,id=x0
+QFLAGS-nographic += -device virtio-blk-device,drive=x0
+endif
+
+# optional virtio console for bulk output: make run CONSOLE=console.out
+ifneq (${CONSOLE},)
+QFLAGS-nographic += -device virtio-serial-device
+QFLAGS-nographic += -chardev file,id=vcon0,path=${CONSOLE}
+QFLAGS-nographic += -device virtconsole,chardev=vcon0
+endif
+
 CC = ${CROSS_COMPILE}gcc
 OBJCOPY = ${CROSS_COMPILE}objcopy
 OBJDUMP = ${CROSS_COMPILE}objdump
 MKDIR = mkdir -p
 RM = rm -rf
 
-OUTPUT_PATH = kernel
-
 # SRCS_ASM & SRCS_C are defined in the Makefile of each project.
 OBJS_ASM := $(addprefix ${OUTPUT_PATH}/, $(patsubst %.S, %.o, ${SRCS_ASM}))
 OBJS_C   := $(addprefix $(OUTPUT_PATH)/, $(patsubst %.c, %.o, ${SRCS_C}))
 OBJS = ${OBJS_ASM} ${OBJS_C}
 
+# foo.S and foo.c would both build ${OUTPUT_PATH}/foo.o and only the
+# .c pattern rule would run, silently dropping the assembly file
+DUP_OBJS := $(filter ${OBJS_ASM}, ${OBJS_C})
+ifneq (${DUP_OBJS},)
+$(error sources build to the same object: ${DUP_OBJS}, rename one of them)
+endif
+
 ELF = ${OUTPUT_PATH}/suepos.elf
 BIN = ${OUTPUT_PATH}/suepos.bin
 
@@ -68,6 +109,26 @@ ${OUTPUT_PATH}/%.o : %.c
 ${OUTPUT_PATH}/%.o : %.S
 	${CC} ${DEFS} ${CFLAGS} -c -o $@ $<
 
+# user programs (user/), run by the exec command. they are packed
+# into the initramfs archive, which initramfs_data.S links into the kernel.
+UPROGS = hello touch
+UPROG_ELFS = $(addprefix ${OUTPUT_PATH}/user/, ${UPROGS})
+UFLAGS = ${ARCHFLAGS} -nostdlib -fno-builtin -ffreestanding -g -Wall -O1
+UFLAGS += -T user/user.ld -Wl,-z,max-page-size=4096
+
+${OUTPUT_PATH}/user/% : user/%.c user/start.S user/ulib.c user/user.h user/user.ld syscall.h
+	@${MKDIR} ${OUTPUT_PATH}/user
+	${CC} ${UFLAGS} -o $@ user/start.S user/ulib.c $<
+
+mkfs/mkinitramfs: mkfs/mkinitramfs.c
+	${HOSTCC} -Wall -o $@ $<
+
+${OUTPUT_PATH}/initramfs.cpio: mkfs/mkinitramfs ${UPROG_ELFS}
+	./mkfs/mkinitramfs $@ ${UPROG_ELFS}
+
+DEFS += -DINITRAMFS_IMAGE='"${OUTPUT_PATH}/initramfs.cpio"'
+${OUTPUT_PATH}/initramfs_data.o: ${OUTPUT_PATH}/initramfs.cpio
+
 run: all
 	@${QEMU} -M ? | grep virt >/dev/null || exit
 	@echo "--Welcome to SUEP Operating System--"
@@ -77,10 +138,24 @@ run: all
 
 
 
+# a blank 32 MiB disk for DISK=disk.img
+disk.img:
+	dd if=/dev/zero of=$@ bs=1M count=32
+
+# host tool building file system images: make run DISK=fs.img
+HOSTCC = gcc
+FS_FILES ?= README.md LICENSE
+
+mkfs/mkfs: mkfs/mkfs.c fs.h type.h
+	${HOSTCC} -Wall -o $@ mkfs/mkfs.c
+
+fs.img: mkfs/mkfs ${FS_FILES}
+	./mkfs/mkfs $@ ${FS_FILES}
+
 .PHONY : code
 code: all
 	@${OBJDUMP} -S ${ELF} | less
 
 .PHONY : clean
 clean:
-	@${RM} ${OUTPUT_PATH}
\ No newline at end of file
+	@${RM} kernel kernel-rv64 mkfs/mkfs mkfs/mkinitramfs
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef __RISCV_H__
+#define __RISCV_H__
+#include "type.h"
+
+/*
+    machine-mode CSR bits and helpers.
+    SuepOS runs entirely in M-mode, so these are the only CSRs we touch.
+*/
+
+// mstatus
+#define MSTATUS_MIE (1 << 3)    // machine interrupt enable
+#define MSTATUS_MPIE (1 << 7)   // MIE before the trap
+#define MSTATUS_MPP (3 << 11)   // mode before the trap, 0 = U
+
+// mie / mip
+#define MIE_MTIE (1 << 7)       // machine timer interrupt
+#define MIE_MEIE (1 << 11)      // machine external interrupt (PLIC)
+
+// mcause
+#define MCAUSE_INTR_BIT ((reg)1 << (sizeof(reg) * 8 - 1))
+#define IRQ_M_TIMER 7
+#define IRQ_M_EXT 11
+#define EXC_U_ECALL 8
+#define EXC_INST_PAGE_FAULT 12
+#define EXC_LOAD_PAGE_FAULT 13
+#define EXC_STORE_PAGE_FAULT 15
+
+// page table entry bits, the same for Sv32 and Sv39
+#define PTE_V (1 << 0)
+#define PTE_R (1 << 1)
+#define PTE_W (1 << 2)
+#define PTE_X (1 << 3)
+#define PTE_U (1 << 4)
+#define PTE_A (1 << 6)
+#define PTE_D (1 << 7)
+#define PTE_OWNED (1 << 8)      // software bit: page belongs to the process
+
+#define PA2PTE(pa) ((((ptr)(pa)) >> PGSHIFT) << 10)
+#define PTE2PA(pte) (((pte) >> 10) << PGSHIFT)
+
+static inline reg r_mhartid(void)
+{
+    reg x;
+    asm volatile("csrr %0, mhartid" : "=r" (x));
+    return x;
+}
+
+// cycle counter, low word is enough for measuring short intervals
+static inline uint32_t r_cycle(void)
+{
+    reg x;
+    asm volatile("rdcycle %0" : "=r" (x));
+    return (uint32_t)x;
+}
+
+static inline void w_mtvec(reg x)
+{
+    asm volatile("csrw mtvec, %0" : : "r" (x));
+}
+
+static inline reg r_mcause(void)
+{
+    reg x;
+    asm volatile("csrr %0, mcause" : "=r" (x));
+    return x;
+}
+
+static inline reg r_mtval(void)
+{
+    reg x;
+    asm volatile("csrr %0, mtval" : "=r" (x));
+    return x;
+}
+
+// only U-mode accesses are translated, M-mode ignores satp
+static inline void w_satp(reg x)
+{
+    asm volatile("csrw satp, %0" : : "r" (x));
+}
+
+static inline void sfence_vma(void)
+{
+    asm volatile("sfence.vma zero, zero");
+}
+
+static inline void fence_i(void)
+{
+    asm volatile("fence.i");
+}
+
+static inline void w_pmpaddr0(reg x)
+{
+    asm volatile("csrw pmpaddr0, %0" : : "r" (x));
+}
+
+static inline void w_pmpcfg0(reg x)
+{
+    asm volatile("csrw pmpcfg0, %0" : : "r" (x));
+}
+
+static inline void w_mcounteren(reg x)
+{
+    asm volatile("csrw mcounteren, %0" : : "r" (x));
+}
+
+static inline void s_mie(reg bits)
+{
+    asm volatile("csrs mie, %0" : : "r" (bits));
+}
+
+// disable interrupts, return whether they were enabled before
+static inline reg intr_off(void)
+{
+    reg x;
+    asm volatile("csrrci %0, mstatus, %1" : "=r" (x) : "i" (MSTATUS_MIE));
+    return x & MSTATUS_MIE;
+}
+
+static inline void intr_on(void)
+{
+    asm volatile("csrsi mstatus, %0" : : "i" (MSTATUS_MIE));
+}
+
+// undo intr_off(), re-enable only if they were enabled before
+static inline void intr_restore(reg was_on)
+{
+    if (was_on) {
+        intr_on();
+    }
+}
+
+#endif
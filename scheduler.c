@@ -1,7 +1,12 @@
 #include "kernel_func.h"
 #include "mem_info.h"
-#define STACK_LENGTH 1024    
-#define MAX_PROCESS 5        
+#define STACK_LENGTH 1024    // default stack, in registers
+#define MAX_PROCESS 8        
+
+typedef enum {
+    SCHED_RR,         // round-robin through pcb_queue
+    SCHED_EDF         // earliest deadline first, through edf_heap
+} SchedClass;
 
 typedef enum {
     PROC_READY,       // 就绪
@@ -13,10 +18,32 @@ typedef enum {
 typedef struct PCB {
     void (*entry)(void);       // func pointer
     CONTEXT context;           // context
-    uint8_t* stack;            // stack ptr
+    uint8_t* stack;            // lowest address, see stack.c
+    uint32_t stack_size;
+    int overflowed;            // stack canary found broken
     ProcState state;           // state 
     int pid;                   // process id
-    struct PCB* next;          // next pcb
+    struct PCB* next;          // next pcb (run queue or wait queue link)
+    WaitQueue* wait_on;        // wait queue while PROC_BLOCKED
+    uint32_t ready_at;         // cycle it became READY, for lat_record()
+    struct UserProc* user;     // program run by exec, NULL for kernel tasks
+    printf_sink_t printf_out;  // mini_printf output, NULL = UART (uart0.c)
+    SchedClass sched_class;
+    // SCHED_EDF only, times in mtime ticks
+    uint32_t runtime;          // budget per job
+    uint32_t period;
+    uint32_t deadline;         // relative to the release
+    uint32_t util;             // runtime/deadline, per mille
+    uint64_t release;          // of the current (or next) job
+    uint64_t abs_deadline;
+    uint64_t switched_in;      // last time it got the CPU
+    uint32_t job_used;         // CPU time of the current job
+    int sleeping;              // waiting for its next release
+    uint32_t max_jobs;         // exit after this many, 0 = never
+    uint32_t jobs;
+    uint32_t misses;           // jobs finished after their deadline
+    uint32_t overruns;         // jobs that used more than runtime
+    uint32_t max_response;     // release to completion
 } PCB;
 
 // 进程队列
@@ -30,11 +57,20 @@ extern void shell();
 static void my_mscratch(reg re);
 void user_first_process(void);
 int CREATE_A_PROCESS(void (*s)(void));
+static void edf_entry(void);
+static void sleep_until_running(PCB* self);
 void scheduler_init(void);
 void process_give_up(void);
 void scheduler(void);
 void delay(int count);
 void process_exit(void);
+void wait_queue_init(WaitQueue* q);
+void wait_queue_sleep(WaitQueue* q);
+struct PCB* wait_queue_wake_one(WaitQueue* q);
+int wait_queue_wake_all(WaitQueue* q);
+int wait_queue_handoff(WaitQueue* q);
+struct PCB* current_process(void);
+int process_is_running(struct PCB* pcb);
 
 static void my_mscratch(reg re) {
     asm volatile("csrw mscratch, %0" : : "r" (re));
@@ -51,6 +87,11 @@ static PCB pcb_pool[MAX_PROCESS];
 static int next_pid = 1;
 static PCB* current_running = NULL;
 
+// ready SCHED_EDF processes, a min-heap on abs_deadline
+static PCB* edf_heap[MAX_PROCESS];
+static int edf_count;
+static uint32_t edf_util;     // admitted, per mille
+
 
 static void init_queue() {
     pcb_queue.head = NULL;
@@ -58,7 +99,10 @@ static void init_queue() {
     pcb_queue.count = 0;
 }
 
+// the run queue is also touched by interrupt handlers waking a
+// process, so every queue operation runs with interrupts off.
 static void enqueue(PCB* pcb) {
+    reg intr = intr_off();
     if (!pcb_queue.head) {
         pcb_queue.head = pcb;
         pcb_queue.tail = pcb;
@@ -68,10 +112,15 @@ static void enqueue(PCB* pcb) {
     }
     pcb->next = NULL;
     pcb_queue.count++;
+    intr_restore(intr);
 }
 
 static PCB* dequeue() {
-    if (!pcb_queue.head) return NULL;
+    reg intr = intr_off();
+    if (!pcb_queue.head) {
+        intr_restore(intr);
+        return NULL;
+    }
     
     PCB* front = pcb_queue.head;
     pcb_queue.head = front->next;
@@ -82,12 +131,14 @@ static PCB* dequeue() {
     
     pcb_queue.count--;
     front->next = NULL;
+    intr_restore(intr);
     return front;
 }
 
 static void remove_from_queue(PCB* pcb) {
     if (!pcb_queue.head || !pcb) return;
     
+    reg intr = intr_off();
     PCB* prev = NULL;
     PCB* curr = pcb_queue.head;
     
@@ -105,25 +156,103 @@ static void remove_from_queue(PCB* pcb) {
             
             pcb_queue.count--;
             curr->next = NULL;
+            intr_restore(intr);
             return;
         }
         prev = curr;
         curr = curr->next;
     }
+    intr_restore(intr);
 }
 
-int CREATE_A_PROCESS(void (*s)(void)) {
-    static int next_pcb_index = 0;  // static var to trace the next index of pcb
-    void* stack_page = page_alloc(1);
-    if (!stack_page) {
-        mini_printf("Error: Stack allocation failed\n");
-        return 0;
+static void edf_push(PCB* pcb) {
+    reg intr = intr_off();
+    int i = edf_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (edf_heap[parent]->abs_deadline <= pcb->abs_deadline) {
+            break;
+        }
+        edf_heap[i] = edf_heap[parent];
+        i = parent;
+    }
+    edf_heap[i] = pcb;
+    intr_restore(intr);
+}
+
+static PCB* edf_pop() {
+    reg intr = intr_off();
+    if (edf_count == 0) {
+        intr_restore(intr);
+        return NULL;
+    }
+
+    PCB* top = edf_heap[0];
+    PCB* last = edf_heap[--edf_count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= edf_count) {
+            break;
+        }
+        if (child + 1 < edf_count &&
+            edf_heap[child + 1]->abs_deadline < edf_heap[child]->abs_deadline) {
+            child++;
+        }
+        if (last->abs_deadline <= edf_heap[child]->abs_deadline) {
+            break;
+        }
+        edf_heap[i] = edf_heap[child];
+        i = child;
+    }
+    edf_heap[i] = last;
+    intr_restore(intr);
+    return top;
+}
+
+// put a READY process where its class picks from
+static void make_ready(PCB* pcb) {
+    pcb->ready_at = r_cycle();
+    if (pcb->sched_class == SCHED_EDF) {
+        edf_push(pcb);
+    } else {
+        enqueue(pcb);
+    }
+}
+
+static int ready_count() {
+    return pcb_queue.count + edf_count;
+}
+
+// every process starts here, so it runs with interrupts enabled
+// and exits cleanly when its entry function returns.
+static void process_entry(void) {
+    intr_on();
+    current_running->entry();
+    process_exit();
+}
+
+static uint32_t stack_overflows;
+
+// report a broken stack canary, once per process
+static void stack_guard(PCB* pcb) {
+    if (!pcb->overflowed && stack_check(pcb->stack) < 0) {
+        pcb->overflowed = 1;
+        stack_overflows++;
+        log_err(LOG_SCHED, "Error: stack overflow in process %d (%u byte stack at %p)\n",
+                pcb->pid, pcb->stack_size, pcb->stack);
     }
+}
+
+// set up a PCB and a stack of stack_size bytes that starts running
+// at `start`, the caller puts it on a queue
+static PCB* new_process(void (*s)(void), void (*start)(void), uint32_t stack_size) {
+    static int next_pcb_index = 0;  // static var to trace the next index of pcb
 
     PCB* pcb = NULL;
     for (int i = 0; i < MAX_PROCESS; i++) {
         int index = (next_pcb_index + i) % MAX_PROCESS;
-        if (pcb_pool[index].state == PROC_FINISHED || pcb_pool[index].state == 0) {
+        if (pcb_pool[index].state == PROC_FINISHED) {
             pcb = &pcb_pool[index];
             next_pcb_index = (index + 1) % MAX_PROCESS; 
             break;
@@ -131,36 +260,114 @@ int CREATE_A_PROCESS(void (*s)(void)) {
     }
     
     if (!pcb) {
-        mini_printf("Error: No available PCB\n");
-        page_free(stack_page);
-        return 0;
+        log_err(LOG_SCHED, "Error: No available PCB\n");
+        return NULL;
+    }
+
+    // process_exit() runs on its stack until the end, so the stack
+    // of a finished process is freed only when its PCB is reused
+    stack_free(pcb->stack, pcb->stack_size);
+    pcb->stack = NULL;
+    stack_size = stack_round(stack_size);
+    void* stack = stack_alloc(stack_size);
+    if (!stack) {
+        log_err(LOG_SCHED, "Error: Stack allocation failed\n");
+        return NULL;
     }
+
     pcb->pid = next_pid++;
     pcb->entry = s;
-    pcb->stack = stack_page;
+    pcb->stack = stack;
+    pcb->stack_size = stack_size;
+    pcb->overflowed = 0;
     pcb->state = PROC_READY;
     pcb->next = NULL;
-    pcb->context.sp = (reg)((uint8_t*)stack_page + PAGE_SIZE) & ~0xF;
-    pcb->context.ra = (reg)s;
+    pcb->wait_on = NULL;
+    pcb->sched_class = SCHED_RR;
+    pcb->sleeping = 0;
+    pcb->user = NULL;
+    pcb->printf_out = NULL;
+    pcb->context.sp = (reg)((uint8_t*)stack + stack_size) & ~0xF;
+    pcb->context.ra = (reg)start;
 
-    mini_printf("Created process %d at PCB[%d]\n", 
-                pcb->pid, pcb - pcb_pool);
-    
-    enqueue(pcb);
+    log_debug(LOG_SCHED, "Created process %d at PCB[%d]\n",
+              pcb->pid, pcb - pcb_pool);
+    return pcb;
+}
+
+int CREATE_A_PROCESS(void (*s)(void)) {
+    return CREATE_SIZED_PROCESS(s, STACK_LENGTH * sizeof(reg));
+}
+
+// like CREATE_A_PROCESS, with a stack of stack_size bytes: under a
+// page for tiny tasks, several pages for deep ones
+int CREATE_SIZED_PROCESS(void (*s)(void), uint32_t stack_size) {
+    PCB* pcb = new_process(s, process_entry, stack_size);
+    if (!pcb) {
+        return 0;
+    }
+    make_ready(pcb);
     return 1;
 }
 
+// a process that runs a user program, s enters it (see exec.c)
+int CREATE_USER_PROCESS(void (*s)(void), struct UserProc* user) {
+    PCB* pcb = new_process(s, process_entry, STACK_LENGTH * sizeof(reg));
+    if (!pcb) {
+        return 0;
+    }
+    pcb->user = user;
+    make_ready(pcb);
+    return pcb->pid;
+}
+
+#if LOG_BUILT(LOG_DEBUG, LOG_SCHED)
 static void debug_queue() {
     mini_printf("Queue: ");
     PCB* current = pcb_queue.head;
     while (current) {
         mini_printf("%d(%s) ", current->pid, 
                    current->state == PROC_READY ? "R" : 
-                   current->state == PROC_RUNNING ? "X" : "F");
+                   current->state == PROC_RUNNING ? "X" :
+                   current->state == PROC_BLOCKED ? "B" : "F");
         current = current->next;
     }
     mini_printf("\n");
 }
+#endif
+
+static void run_process(PCB* next) {
+    if (current_running) {
+        stack_guard(current_running);
+    }
+
+    // a blocked or finished process must keep its state,
+    // otherwise it would look runnable to the next wakeup.
+    if (current_running && current_running->state == PROC_RUNNING) {
+        current_running->state = PROC_READY;
+    }
+    
+    // EDF jobs are charged for the CPU time they actually get
+    if ((current_running && current_running->sched_class == SCHED_EDF) ||
+        next->sched_class == SCHED_EDF) {
+        uint64_t now = read_mtime();
+        if (current_running && current_running->sched_class == SCHED_EDF) {
+            current_running->job_used += (uint32_t)(now - current_running->switched_in);
+        }
+        next->switched_in = now;
+    }
+
+    lat_record(next->sched_class == SCHED_EDF ? LAT_WAKE_EDF : LAT_WAKE_RR,
+               r_cycle() - next->ready_at);
+    next->state = PROC_RUNNING;
+    current_running = next;
+    
+    // the interrupt enable bit belongs to the process: switch with
+    // interrupts off and restore our own setting once we run again.
+    reg intr = intr_off();
+    switch_to_context(&next->context);
+    intr_restore(intr);
+}
 
 void scheduler_init(void) {
     my_mscratch(0);
@@ -168,27 +375,37 @@ void scheduler_init(void) {
     for (int i = 0; i < MAX_PROCESS; i++) {
         pcb_pool[i].state = PROC_FINISHED;
         pcb_pool[i].stack = NULL;
+        pcb_pool[i].stack_size = 0;
         pcb_pool[i].next = NULL;
+        pcb_pool[i].wait_on = NULL;
         pcb_pool[i].pid = -1; 
     }
-    mini_printf("Scheduler initialized with %d PCBs\n", MAX_PROCESS);
+    log_info(LOG_SCHED, "Scheduler initialized with %d PCBs\n", MAX_PROCESS);
 }
 
 
 // make RUNNING state -> REDAY state
 void process_give_up(void) {
+    if (ready_count() == 0 && current_running) {
+        return;  // nobody else is ready, keep running
+    }
     if (current_running && current_running->state == PROC_RUNNING) {
         current_running->state = PROC_READY;
-        enqueue(current_running);
+        make_ready(current_running);
     }
     scheduler();
 }
 
 void scheduler() {
-    debug_queue();
-    
-    PCB* next = NULL;
-    while (pcb_queue.count > 0) {
+#if LOG_BUILT(LOG_DEBUG, LOG_SCHED)
+    if (log_level >= LOG_DEBUG) {
+        debug_queue();
+    }
+#endif
+
+    // a released EDF job always goes before round-robin work
+    PCB* next = edf_pop();
+    while (!next && pcb_queue.count > 0) {
         next = dequeue();
         if (next->state == PROC_READY) {
             break;
@@ -197,18 +414,11 @@ void scheduler() {
     }
     
     if (!next) {
-        mini_printf("No ready process\n");
+        log_debug(LOG_SCHED, "No ready process\n");
         return;
     }
 
-    if (current_running) {
-        current_running->state = PROC_READY;
-    }
-    
-    next->state = PROC_RUNNING;
-    current_running = next;
-    
-    switch_to_context(&next->context);
+    run_process(next);
 }
 
 void delay(int count) {
@@ -225,15 +435,387 @@ void delay(int count) {
 void process_exit(void)
 {
     if (current_running){
-        void* stack_to_free = current_running->stack;
         int pid_to_free = current_running->pid;
 
         current_running->state = PROC_FINISHED;
         remove_from_queue(current_running);
-        mini_printf("Process %d exiting\n", pid_to_free);
-        page_free(stack_to_free);
-        scheduler();
-        while (1);
+        if (current_running->sched_class == SCHED_EDF) {
+            edf_util -= current_running->util;
+        }
+        if (current_running->user) {
+            exec_release(current_running->user);
+            current_running->user = NULL;
+        }
+        stack_guard(current_running);
+        log_debug(LOG_SCHED, "Process %d exiting\n", pid_to_free);
+        // idle until some blocked process gets woken by an interrupt
+        while (1) {
+            if (ready_count() > 0) {
+                scheduler();
+            }
+            intr_on();
+            asm volatile("wfi");
+        }
         
     }
-}
\ No newline at end of file
+}
+
+
+/*
+ * WAIT QUEUES
+ * a blocked process leaves the run queue entirely and is linked
+ * into the wait queue through its `next` field, so sleeping costs
+ * no CPU and waking the first waiter is O(1).
+ */
+void wait_queue_init(WaitQueue* q)
+{
+    q->head = NULL;
+    q->tail = NULL;
+    q->count = 0;
+}
+
+// run others until self is picked again, called with interrupts off
+// after self left the RUNNING state. once woken it sits READY in
+// its class's queue until the scheduler picks it.
+static void sleep_until_running(PCB* self)
+{
+    while (self->state != PROC_RUNNING) {
+        if (ready_count() > 0) {
+            scheduler();
+        } else {
+            // nothing is runnable: only an interrupt can wake us now
+            asm volatile("wfi");
+            intr_on();
+            intr_off();
+        }
+    }
+}
+
+// make RUNNING state -> BLOCKED state, until someone wakes us up
+void wait_queue_sleep(WaitQueue* q)
+{
+    PCB* self = current_running;
+    if (!self) {
+        return;  // not in process context, nobody to put to sleep
+    }
+
+    // callers that test a condition before sleeping should hold
+    // interrupts off across the test, so a wakeup cannot slip in.
+    reg intr = intr_off();
+    self->state = PROC_BLOCKED;
+    self->wait_on = q;
+    self->next = NULL;
+    if (!q->head) {
+        q->head = self;
+    } else {
+        q->tail->next = self;
+    }
+    q->tail = self;
+    q->count++;
+
+    sleep_until_running(self);
+    intr_restore(intr);
+}
+
+static PCB* wait_queue_pop(WaitQueue* q)
+{
+    reg intr = intr_off();
+    PCB* pcb = q->head;
+    if (!pcb) {
+        intr_restore(intr);
+        return NULL;
+    }
+
+    q->head = pcb->next;
+    if (!q->head) {
+        q->tail = NULL;
+    }
+    q->count--;
+
+    pcb->next = NULL;
+    pcb->wait_on = NULL;
+    intr_restore(intr);
+    return pcb;
+}
+
+// make BLOCKED state -> READY state for the first waiter
+struct PCB* wait_queue_wake_one(WaitQueue* q)
+{
+    PCB* pcb = wait_queue_pop(q);
+    if (!pcb) {
+        return NULL;
+    }
+
+    pcb->state = PROC_READY;
+    make_ready(pcb);
+    return pcb;
+}
+
+int wait_queue_wake_all(WaitQueue* q)
+{
+    int woken = 0;
+    while (wait_queue_wake_one(q)) {
+        woken++;
+    }
+    return woken;
+}
+
+// wake the first waiter and switch to it right away, skipping the
+// run queue. the caller goes to the tail of the run queue instead.
+// used when the waiter is the one who consumes what we just produced.
+int wait_queue_handoff(WaitQueue* q)
+{
+    PCB* pcb = wait_queue_pop(q);
+    if (!pcb) {
+        return 0;
+    }
+
+    if (!current_running || current_running->state != PROC_RUNNING) {
+        pcb->state = PROC_READY;
+        make_ready(pcb);
+        return 1;
+    }
+
+    current_running->state = PROC_READY;
+    make_ready(current_running);
+    pcb->ready_at = r_cycle();
+    run_process(pcb);
+    return 1;
+}
+
+struct PCB* current_process(void)
+{
+    return current_running;
+}
+
+int process_is_running(struct PCB* pcb)
+{
+    return pcb && pcb->state == PROC_RUNNING;
+}
+
+struct UserProc* process_user(void)
+{
+    return current_running ? current_running->user : NULL;
+}
+
+int process_pid(void)
+{
+    return current_running ? current_running->pid : -1;
+}
+
+// printf_redirect() state of the current process, NULL at boot
+printf_sink_t* process_printf_sink(void)
+{
+    return current_running ? &current_running->printf_out : NULL;
+}
+
+
+/*
+ * EARLIEST DEADLINE FIRST
+ * a SCHED_EDF process runs its job function once per period. a job
+ * is released at the start of its period and must finish within
+ * `deadline` of it. released jobs go before any round-robin process
+ * and among themselves the earliest absolute deadline wins. the
+ * kernel is cooperative, so a released job takes the CPU at the
+ * next scheduling point (a yield, a sleep or an idle wfi), not in
+ * the middle of another process.
+ *
+ * admission control keeps the sum of runtime/deadline under
+ * EDF_MAX_UTIL, so admitted tasks can meet their deadlines and the
+ * shell and other round-robin work still get the rest.
+ */
+
+static uint32_t us_to_ticks(uint32_t us)
+{
+    return us * (TIMER_FREQ / 1000000);
+}
+
+// program the timer for the earliest pending release, or the next
+// periodic callback (timer.c) if that comes first
+static void edf_arm_timer(void)
+{
+    uint64_t next = timer_periodic_next();
+    for (int i = 0; i < MAX_PROCESS; i++) {
+        PCB* pcb = &pcb_pool[i];
+        if (pcb->state == PROC_BLOCKED && pcb->sleeping &&
+            (next == 0 || pcb->release < next)) {
+            next = pcb->release;
+        }
+    }
+    if (next) {
+        timer_arm(next);
+    } else {
+        timer_disarm();
+    }
+}
+
+static void edf_release(PCB* pcb)
+{
+    pcb->abs_deadline = pcb->release + pcb->deadline;
+    pcb->job_used = 0;
+    pcb->sleeping = 0;
+    pcb->state = PROC_READY;
+    make_ready(pcb);
+}
+
+// machine timer interrupt: release every job whose period began
+void edf_timer_interrupt(void)
+{
+    uint64_t now = read_mtime();
+    for (int i = 0; i < MAX_PROCESS; i++) {
+        PCB* pcb = &pcb_pool[i];
+        if (pcb->state == PROC_BLOCKED && pcb->sleeping && pcb->release <= now) {
+            edf_release(pcb);
+        }
+    }
+    edf_arm_timer();
+}
+
+// the job returned: account it and sleep until the next release
+static void edf_job_done(void)
+{
+    PCB* self = current_running;
+    reg intr = intr_off();
+    uint64_t now = read_mtime();
+
+    self->job_used += (uint32_t)(now - self->switched_in);
+    self->switched_in = now;
+    self->jobs++;
+    if (now > self->abs_deadline) {
+        self->misses++;
+    }
+    if (self->job_used > self->runtime) {
+        self->overruns++;
+    }
+    uint32_t response = (uint32_t)(now - self->release);
+    if (response > self->max_response) {
+        self->max_response = response;
+    }
+    if (self->max_jobs && self->jobs >= self->max_jobs) {
+        intr_restore(intr);
+        return;   // the last one, edf_entry() exits
+    }
+
+    // a job that ran into its next period(s) skips them
+    self->release += self->period;
+    while (self->release + self->period <= now) {
+        self->release += self->period;
+    }
+
+    if (self->release <= now) {
+        edf_release(self);
+        scheduler();
+    } else {
+        self->state = PROC_BLOCKED;
+        self->sleeping = 1;
+        edf_arm_timer();
+        sleep_until_running(self);
+    }
+    intr_restore(intr);
+}
+
+static void edf_entry(void) {
+    intr_on();
+    while (current_running->max_jobs == 0 ||
+           current_running->jobs < current_running->max_jobs) {
+        current_running->entry();
+        edf_job_done();
+    }
+    log_info(LOG_SCHED, "EDF pid %d done: %u jobs, %u deadline misses\n",
+             current_running->pid, current_running->jobs, current_running->misses);
+    process_exit();   // gives back the PCB and the admitted utilization
+}
+
+// CREATE_A_PROCESS for a periodic task, its first job is released now.
+// the task exits after max_jobs jobs, or never if max_jobs is 0.
+// returns 0 if the task does not fit next to the ones admitted already.
+int CREATE_EDF_PROCESS(void (*job)(void), uint32_t runtime, uint32_t period, uint32_t deadline,
+                       uint32_t max_jobs)
+{
+    if (deadline == 0) {
+        deadline = period;
+    }
+    // us_to_ticks() must not overflow 32 bits
+    if (runtime == 0 || runtime > deadline || deadline > period ||
+        period > 0xffffffff / (TIMER_FREQ / 1000000)) {
+        log_err(LOG_SCHED, "Error: EDF needs 0 < runtime <= deadline <= period\n");
+        return 0;
+    }
+    // per mille, rounded up so admission stays on the safe side.
+    // scale both down first so runtime * 1000 fits in 32 bits.
+    uint32_t r = runtime, d = deadline;
+    while (r > 4000000) {
+        r >>= 1;
+        d >>= 1;
+    }
+    uint32_t util = (r * 1000 + d - 1) / d;
+    if (edf_util + util > EDF_MAX_UTIL) {
+        log_err(LOG_SCHED, "Error: EDF admission failed, utilization %u + %u > %u per mille\n",
+                    edf_util, util, EDF_MAX_UTIL);
+        return 0;
+    }
+
+    PCB* pcb = new_process(job, edf_entry, STACK_LENGTH * sizeof(reg));
+    if (!pcb) {
+        return 0;
+    }
+    pcb->sched_class = SCHED_EDF;
+    pcb->runtime = us_to_ticks(runtime);
+    pcb->period = us_to_ticks(period);
+    pcb->deadline = us_to_ticks(deadline);
+    pcb->util = util;
+    pcb->max_jobs = max_jobs;
+    pcb->jobs = 0;
+    pcb->misses = 0;
+    pcb->overruns = 0;
+    pcb->max_response = 0;
+    edf_util += util;
+
+    reg intr = intr_off();
+    pcb->release = read_mtime();
+    edf_release(pcb);
+    intr_restore(intr);
+    return 1;
+}
+
+// runtime of the current job's task, for jobs that size their work
+uint32_t edf_budget_us(void)
+{
+    if (!current_running || current_running->sched_class != SCHED_EDF) {
+        return 0;
+    }
+    return ticks_to_us(current_running->runtime);
+}
+
+void edf_stat(void)
+{
+    mini_printf("EDF utilization: %u of %u per mille admitted\n", edf_util, EDF_MAX_UTIL);
+    for (int i = 0; i < MAX_PROCESS; i++) {
+        PCB* pcb = &pcb_pool[i];
+        if (pcb->state == PROC_FINISHED || pcb->sched_class != SCHED_EDF) {
+            continue;
+        }
+        mini_printf("pid %d: runtime %u period %u deadline %u us\n", pcb->pid,
+                    ticks_to_us(pcb->runtime), ticks_to_us(pcb->period),
+                    ticks_to_us(pcb->deadline));
+        mini_printf("  %u jobs, %u deadline misses, %u overruns, max response %u us\n",
+                    pcb->jobs, pcb->misses, pcb->overruns, ticks_to_us(pcb->max_response));
+    }
+}
+
+// stack size and deepest use of every live process
+void stack_stat(void)
+{
+    for (int i = 0; i < MAX_PROCESS; i++) {
+        PCB* pcb = &pcb_pool[i];
+        if (pcb->state == PROC_FINISHED) {
+            continue;
+        }
+        stack_guard(pcb);
+        mini_printf("pid %d: %u byte stack, %u used%s\n", pcb->pid, pcb->stack_size,
+                    stack_used(pcb->stack, pcb->stack_size),
+                    pcb->overflowed ? ", OVERFLOWED" : "");
+    }
+    mini_printf("%u overflows detected\n", stack_overflows);
+    stack_cache_stat();
+}
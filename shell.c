@@ -40,11 +40,8 @@ void execute_command(int argc, char *argv[])
             return;
         }
     }
-    uart0_put_string("'");
-    uart0_put_string(argv[0]);
-    uart0_put_string("'");
-    uart0_put_string(" command not found, please do registration.");
-    uart0_put_string("\ninput 'help' to check all commands.\n");
+    mini_printf("'%s' command not found, please do registration.", argv[0]);
+    mini_printf("\ninput 'help' to check all commands.\n");
 }
 
 
@@ -52,41 +49,315 @@ void execute_command(int argc, char *argv[])
 // OF COURSE, ALL IMPLEMENTATION SHOULD BE WRITTEN HERE.
 void cmd_help(int argc, char *argv[])
 {
-    uart0_put_string("you can input:\n");
+    mini_printf("you can input:\n");
     for (int i = 0; commands[i].name != NULL; i++) {
-        uart0_put_string("  ");
-        uart0_put_string(commands[i].name);
-        uart0_put_string(" - ");
-        uart0_put_string(commands[i].help);
-        uart0_put_string("\n");
+        mini_printf("  %s - %s\n", commands[i].name, commands[i].help);
     }
 }
 
 void cmd_echo(int argc, char *argv[])
 {
     for (int i = 1; i < argc; i++) {
-        uart0_put_string(argv[i]);
-        if (i < argc - 1) uart0_put_string(" ");
+        mini_printf("%s", argv[i]);
+        if (i < argc - 1) mini_printf(" ");
     }
-    uart0_put_string("\n");
+    mini_printf("\n");
 }
 
 void cmd_clear(int argc, char *argv[])
 {
-    uart0_put_string("\033[2J\033[H");  
+    mini_printf("\033[2J\033[H");  
 }
 
 void cmd_info(int argc, char *argv[])
 {
-    uart0_put_string("RISC-V SUEP OS Shell\n");
-    uart0_put_string("BASED ON QEMU VIRT-MACHINE\n");
-    uart0_put_string("ARCH: RV64\n");
+    mini_printf("RISC-V SUEP OS Shell\n");
+    mini_printf("BASED ON QEMU VIRT-MACHINE\n");
+    mini_printf("ARCH: RV64\n");
 }
 
-// void cmd_exec(int argc, char *argv[])
-// {
+static int str_to_int(const char *s, int def)
+{
+    int n = 0;
+    if (!s || *s < '0' || *s > '9') return def;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s++ - '0');
+    }
+    return n;
+}
+
+void cmd_ipcbench(int argc, char *argv[])
+{
+    int rounds = str_to_int(argc > 1 ? argv[1] : NULL, 1000);
+    int use_pages = argc > 2 && strcmp(argv[2], "page") == 0;
+    ipc_bench(rounds, use_pages);
+}
+
+void cmd_blkbench(int argc, char *argv[])
+{
+    int nreq = str_to_int(argc > 1 ? argv[1] : NULL, 256);
+    int do_write = argc > 2 && strcmp(argv[2], "w") == 0;
+    virtio_blk_bench(nreq, do_write);
+}
+
+void cmd_cachestat(int argc, char *argv[])
+{
+    bcache_stat();
+}
+
+void cmd_sync(int argc, char *argv[])
+{
+    bsync();
+}
+
+void cmd_irqstat(int argc, char *argv[])
+{
+    irq_stat();
+}
+
+#define EDF_DEMO_JOBS 1000
+
+// busy for 3/4 of its budget every period
+static void edf_demo_job(void)
+{
+    uint64_t end = read_mtime() + edf_budget_us() * 3 / 4 * (TIMER_FREQ / 1000000);
+    while (read_mtime() < end);
+}
+
+void cmd_edf(int argc, char *argv[])
+{
+    if (argc >= 3) {
+        uint32_t runtime = str_to_int(argv[1], 0);
+        uint32_t period = str_to_int(argv[2], 0);
+        uint32_t deadline = str_to_int(argc > 3 ? argv[3] : NULL, period);
+        uint32_t jobs = str_to_int(argc > 4 ? argv[4] : NULL, EDF_DEMO_JOBS);
+        if (!CREATE_EDF_PROCESS(edf_demo_job, runtime, period, deadline, jobs)) {
+            return;
+        }
+    }
+    edf_stat();
+}
+
+void cmd_lat(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        lat_reset();
+        return;
+    }
+    lat_stat();
+}
+
+static void print_name(const char *name, int len)
+{
+    printf_write(name, len);
+}
+
+static void ls_entry(const char *name, int len, uint32_t inum, void *arg)
+{
+    Inode *ip = iget(*(int *)arg, inum);
+    if (!ip) return;
+    ilock(ip);
+    mini_printf("%s %d ", ip->d.type == T_DIR ? "d" : "-", ip->d.size);
+    iunlock(ip);
+    iput(ip);
+    print_name(name, len);
+    mini_printf("\n");
+}
+
+void cmd_ls(int argc, char *argv[])
+{
+    Inode *dp = namei(argc > 1 ? argv[1] : "/");
+    if (!dp) {
+        mini_printf("ls: not found\n");
+        return;
+    }
+    ilock(dp);
+    if (dp->d.type == T_DIR) {
+        int n = dir_iterate(dp, ls_entry, &dp->dev);
+        mini_printf("%d entries\n", n);
+    } else {
+        mini_printf("- %d %s\n", dp->d.size, argv[1]);
+    }
+    iunlock(dp);
+    iput(dp);
+}
+
+void cmd_cat(int argc, char *argv[])
+{
+    int timed = argc > 2 && strcmp(argv[1], "-t") == 0;
+    if (argc < 2 || (timed && argc < 3)) {
+        mini_printf("usage: cat [-t] <file>\n");
+        return;
+    }
+
+    Inode *ip = namei(argv[timed ? 2 : 1]);
+    if (!ip) {
+        mini_printf("cat: not found\n");
+        return;
+    }
+
+    ilock(ip);
+    if (timed) {
+        // stream the whole file through one page, nothing printed
+        uint8_t *page = page_alloc(1);
+        uint32_t off = 0;
+        int n;
+        uint64_t start = read_mtime();
+        while (page && (n = readi(ip, page, off, BLOCK_SIZE)) > 0) {
+            off += n;
+        }
+        uint32_t us = ticks_to_us((uint32_t)(read_mtime() - start));
+        page_free(page);
+        mini_printf("%u bytes in %u us", off, us);
+        if (us >= 1000) {
+            mini_printf(", %u KiB/s", (off / 1024) * 1000 / (us / 1000));
+        }
+        mini_printf("\n");
+    } else {
+        char buf[128];
+        uint32_t off = 0;
+        int n;
+        while ((n = readi(ip, buf, off, sizeof(buf))) > 0) {
+            printf_write(buf, n);
+            off += n;
+        }
+    }
+    iunlock(ip);
+    iput(ip);
+}
+
+void cmd_write(int argc, char *argv[])
+{
+    if (argc < 3) {
+        mini_printf("usage: write <file> <text...>\n");
+        return;
+    }
+
+    Inode *ip = fs_create(argv[1], T_FILE);
+    if (!ip) {
+        mini_printf("write: cannot create file\n");
+        return;
+    }
+
+    ilock(ip);
+    if (ip->d.type != T_FILE) {
+        // fs_create() returns what already has this name
+        mini_printf("write: not a file\n");
+        iunlock(ip);
+        iput(ip);
+        return;
+    }
+    itrunc(ip, 0);
+    uint32_t off = 0;
+    for (int i = 2; i < argc; i++) {
+        int n = writei(ip, argv[i], off, strlen(argv[i]));
+        if (n >= 0) {
+            off += n;
+            n = writei(ip, i < argc - 1 ? " " : "\n", off, 1);
+        }
+        if (n < 0) {
+            mini_printf("write: stopped after %u bytes\n", off);
+            break;
+        }
+        off += n;
+    }
+    iunlock(ip);
+    iput(ip);
+}
+
+void cmd_stat(int argc, char *argv[])
+{
+    if (argc < 2) {
+        mini_printf("usage: stat <path>\n");
+        return;
+    }
 
-// }
+    uint64_t start = read_mtime();
+    Inode *ip = namei(argv[1]);
+    uint32_t lookup_us = ticks_to_us((uint32_t)(read_mtime() - start));
+    if (!ip) {
+        mini_printf("stat: not found\n");
+        return;
+    }
+
+    ilock(ip);
+    mini_printf("inode %d, %s, %d bytes, %d links\n", ip->inum,
+                ip->d.type == T_DIR ? "directory" : "file", ip->d.size, ip->d.nlink);
+    if (ip->d.type == T_DIR) {
+        mini_printf("%d entries in %d buckets\n", ip->d.nentries, ip->d.size / FS_BLOCK_SIZE);
+    }
+    for (uint32_t i = 0; i < ip->d.nextents; i++) {
+        mini_printf("extent %d: blocks %d..%d\n", i, ip->d.ext[i].start,
+                    ip->d.ext[i].start + ip->d.ext[i].len - 1);
+    }
+    mini_printf("lookup took %u us\n", lookup_us);
+    iunlock(ip);
+    iput(ip);
+}
+
+void cmd_exec(int argc, char *argv[])
+{
+    if (argc < 2) {
+        initramfs_list();
+        return;
+    }
+    exec_program(argc - 1, argv + 1);
+}
+
+void cmd_loglevel(int argc, char *argv[])
+{
+    if (argc > 1 && log_set_level(argv[1]) < 0) {
+        mini_printf("loglevel: not built in, see LOG_LEVEL in qemu_gcc.mk\n");
+    }
+    log_stat();
+}
+
+void cmd_dmesg(int argc, char *argv[])
+{
+    dmesg();
+}
+
+void cmd_bulk(int argc, char *argv[])
+{
+    if (argc < 2) {
+        vcon_stat();
+        return;
+    }
+    if (!vcon_present()) {
+        mini_printf("bulk: no virtio console, see CONSOLE in qemu_gcc.mk\n");
+        return;
+    }
+
+    uint32_t bytes = vcon_bytes();
+    uint64_t start = read_mtime();
+    // only this process's output, see printf_redirect()
+    printf_sink_t old = printf_redirect(vcon_write);
+    execute_command(argc - 1, argv + 1);
+    vcon_flush();
+    printf_redirect(old);
+    uint32_t us = ticks_to_us((uint32_t)(read_mtime() - start));
+
+    mini_printf("bulk: %u bytes to the virtio console in %u us\n", vcon_bytes() - bytes, us);
+}
+
+void cmd_conbench(int argc, char *argv[])
+{
+    vcon_bench(str_to_int(argc > 1 ? argv[1] : NULL, 4096));
+}
+
+void cmd_stacks(int argc, char *argv[])
+{
+    stack_stat();
+}
+
+void cmd_pagestat(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        page_bench(str_to_int(argc > 2 ? argv[2] : NULL, 100),
+                   str_to_int(argc > 3 ? argv[3] : NULL, 8));
+    }
+    page_stats();
+}
 
 void shell(void)
 {
@@ -97,16 +368,23 @@ void shell(void)
     // 初始化UART
     uart0_init();
     
-    uart0_put_string("\nSuep OS Shell v1.0\n");
-    uart0_put_string("input 'help' to check all commands.\n");
+    mini_printf("\nSuep OS Shell v1.0\n");
+    mini_printf("input 'help' to check all commands.\n");
     
     while (1) {
-        uart0_put_string("kernel@SuepOS: ");
+        mini_printf("kernel@SuepOS: ");
         readline(line, MAX_CMD_LENGTH);
         
         argc = parse_command(line, argv);
         if (argc > 0) {
+#if LOG_BUILT(LOG_DEBUG, LOG_SHELL)
+            uint64_t start = read_mtime();
+            execute_command(argc, argv);
+            log_debug(LOG_SHELL, "shell: %s took %u us\n", argv[0],
+                      ticks_to_us((uint32_t)(read_mtime() - start)));
+#else
             execute_command(argc, argv);
+#endif
         }
     }
 }
@@ -0,0 +1,145 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+
+/*
+    PROCESS STACKS
+    every process gets a stack of the size asked for at creation:
+    - under a page: a slot from the stack cache, which carves pages
+      into 512, 1024 or 2048 byte slots and keeps freed slots for the
+      next process of that size.
+    - a page or more: whole pages from page_alloc.
+
+    the lowest STACK_CANARY_WORDS words of a stack hold a canary, the
+    rest starts out as STACK_FILL. the scheduler checks the canary
+    every time it switches away from a process, so an overflow is
+    reported at the next switch (stack_check), and the fill tells how
+    deep a stack has ever been used (stack_used).
+*/
+
+#define STACK_MIN 512
+#define STACK_NCLASSES 3                    // 512, 1024, 2048
+#define STACK_CANARY_WORDS 4
+#define STACK_CANARY ((reg)0x5a17c0de)      // xor'ed with the stack address
+#define STACK_FILL 0xa5
+
+typedef struct StackSlot {
+    struct StackSlot* next;                 // while on the free list
+} StackSlot;
+
+static struct {
+    StackSlot* free;
+    uint32_t pages;                         // carved so far, never given back
+    uint32_t in_use;
+} stack_cache[STACK_NCLASSES];
+
+static int stack_class(uint32_t size)
+{
+    int c = 0;
+    while ((STACK_MIN << c) < size) {
+        c++;
+    }
+    return c;
+}
+
+// the size stack_alloc() really hands out for a request of `size`
+uint32_t stack_round(uint32_t size)
+{
+    if (size < STACK_MIN) {
+        size = STACK_MIN;
+    }
+    if (size <= PAGE_SIZE / 2) {
+        return STACK_MIN << stack_class(size);
+    }
+    return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+// size must come from stack_round()
+void* stack_alloc(uint32_t size)
+{
+    void* stack;
+
+    reg intr = intr_off();
+    if (size < PAGE_SIZE) {
+        int c = stack_class(size);
+        if (!stack_cache[c].free) {
+            uint8_t* page = page_alloc(1);
+            if (!page) {
+                intr_restore(intr);
+                return NULL;
+            }
+            for (uint32_t off = 0; off < PAGE_SIZE; off += size) {
+                StackSlot* slot = (StackSlot*)(page + off);
+                slot->next = stack_cache[c].free;
+                stack_cache[c].free = slot;
+            }
+            stack_cache[c].pages++;
+        }
+        stack = stack_cache[c].free;
+        stack_cache[c].free = stack_cache[c].free->next;
+        stack_cache[c].in_use++;
+    } else {
+        stack = page_alloc(size / PAGE_SIZE);
+    }
+    intr_restore(intr);
+
+    if (stack) {
+        memset(stack, STACK_FILL, size);
+        reg* canary = stack;
+        for (int i = 0; i < STACK_CANARY_WORDS; i++) {
+            canary[i] = STACK_CANARY ^ (reg)stack;
+        }
+    }
+    return stack;
+}
+
+void stack_free(void* stack, uint32_t size)
+{
+    if (!stack) {
+        return;
+    }
+    reg intr = intr_off();
+    if (size < PAGE_SIZE) {
+        int c = stack_class(size);
+        StackSlot* slot = stack;
+        slot->next = stack_cache[c].free;
+        stack_cache[c].free = slot;
+        stack_cache[c].in_use--;
+    } else {
+        page_free(stack);
+    }
+    intr_restore(intr);
+}
+
+// 0 while the canary is intact
+int stack_check(void* stack)
+{
+    reg* canary = stack;
+    for (int i = 0; i < STACK_CANARY_WORDS; i++) {
+        if (canary[i] != (STACK_CANARY ^ (reg)stack)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// deepest use so far in bytes, counting from the top
+uint32_t stack_used(void* stack, uint32_t size)
+{
+    uint8_t* p = (uint8_t*)stack + STACK_CANARY_WORDS * sizeof(reg);
+    uint8_t* end = (uint8_t*)stack + size;
+    while (p < end && *p == STACK_FILL) {
+        p++;
+    }
+    return end - p;
+}
+
+void stack_cache_stat(void)
+{
+    for (int c = 0; c < STACK_NCLASSES; c++) {
+        if (!stack_cache[c].pages) {
+            continue;
+        }
+        mini_printf("stack cache %u: %u in use, %u pages\n",
+                    STACK_MIN << c, stack_cache[c].in_use, stack_cache[c].pages);
+    }
+}
@@ -0,0 +1,127 @@
+#include "kernel_func.h"
+
+/*
+ * sleeping synchronization primitives built on the wait queues
+ * of the scheduler. a waiter is BLOCKED and off the run queue,
+ * so a contended resource costs no CPU while waiting.
+ *
+ * ownership is handed over directly on release: the woken process
+ * already holds the mutex (or the semaphore unit) when it runs,
+ * so there is no retry loop and no thundering herd.
+ */
+
+
+// MUTEX
+void mutex_init(Mutex* m, int spin)
+{
+    m->locked = 0;
+    m->owner = NULL;
+    m->spin = spin;
+    m->contended = 0;
+    wait_queue_init(&m->waiters);
+}
+
+int mutex_trylock(Mutex* m)
+{
+    if (m->locked) {
+        return 0;
+    }
+    m->locked = 1;
+    m->owner = current_process();
+    return 1;
+}
+
+void mutex_lock(Mutex* m)
+{
+    if (mutex_trylock(m)) {
+        return;
+    }
+
+    // adaptive spinning: while the owner is running on another hart
+    // it will probably release soon, cheaper than two switches.
+    for (int i = 0; i < m->spin && m->locked && process_is_running(m->owner); i++) {
+        asm volatile("nop");
+    }
+    if (mutex_trylock(m)) {
+        return;
+    }
+
+    m->contended++;
+    wait_queue_sleep(&m->waiters);
+    // woken by mutex_unlock(), which already made us the owner
+}
+
+void mutex_unlock(Mutex* m)
+{
+    if (!m->locked || m->owner != current_process()) {
+        log_err(LOG_SCHED, "mutex_unlock: %p not held by pid %d\n", m, process_pid());
+        return;
+    }
+    struct PCB* next = wait_queue_wake_one(&m->waiters);
+    if (next) {
+        m->owner = next;       // hand-off, m->locked stays 1
+        return;
+    }
+    m->owner = NULL;
+    m->locked = 0;
+}
+
+
+// COUNTING SEMAPHORE
+void sem_init(Semaphore* s, int count)
+{
+    s->count = count;
+    wait_queue_init(&s->waiters);
+}
+
+int sem_trydown(Semaphore* s)
+{
+    if (s->count > 0) {
+        s->count--;
+        return 1;
+    }
+    return 0;
+}
+
+void sem_down(Semaphore* s)
+{
+    if (sem_trydown(s)) {
+        return;
+    }
+    wait_queue_sleep(&s->waiters);
+    // woken by sem_up(), which passed its unit to us
+}
+
+void sem_up(Semaphore* s)
+{
+    if (wait_queue_wake_one(&s->waiters)) {
+        return;
+    }
+    s->count++;
+}
+
+
+// CONDITION VARIABLE
+void cond_init(CondVar* cv)
+{
+    wait_queue_init(&cv->waiters);
+}
+
+// the caller must hold m. the scheduler is not preemptive, so no
+// other process can signal between the unlock and the sleep.
+void cond_wait(CondVar* cv, Mutex* m)
+{
+    mutex_unlock(m);
+    wait_queue_sleep(&cv->waiters);
+    mutex_lock(m);
+}
+
+void cond_signal(CondVar* cv)
+{
+    wait_queue_wake_one(&cv->waiters);
+}
+
+void cond_broadcast(CondVar* cv)
+{
+    wait_queue_wake_all(&cv->waiters);
+}
@@ -0,0 +1,15 @@
+#ifndef __SYSCALL_H__
+#define __SYSCALL_H__
+
+/*
+    system call numbers, shared by the kernel (exec.c) and the user
+    programs (user/ulib.c). the number goes in a7, arguments in a0..a2,
+    the result comes back in a0.
+*/
+
+#define SYS_write 1      // write(fd, buf, len), fd is ignored: console
+#define SYS_exit  2      // exit(code)
+#define SYS_yield 3      // let other processes run
+#define SYS_getpid 4
+
+#endif
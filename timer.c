@@ -0,0 +1,129 @@
+#include "kernel_func.h"
+
+// read the 64-bit CLINT mtime counter (TIMER_FREQ ticks per second).
+// on rv32 it takes two loads, retry if the high half moved in between.
+uint64_t read_mtime(void)
+{
+#if __riscv_xlen == 64
+    return *(volatile uint64_t *)CLINT_MTIME;
+#else
+    volatile uint32_t *mtime = (volatile uint32_t *)CLINT_MTIME;
+    uint32_t hi, lo;
+    do {
+        hi = mtime[1];
+        lo = mtime[0];
+    } while (hi != mtime[1]);
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+// convert a short tick interval to microseconds, without 64-bit division
+uint32_t ticks_to_us(uint32_t ticks)
+{
+    return ticks / (TIMER_FREQ / 1000000);
+}
+
+static uint64_t armed_at[MAX_CPU];   // 0 while disarmed
+
+// raise a machine timer interrupt once mtime reaches `when`.
+// on rv32 the high half goes to all ones first so the compare
+// cannot match halfway through the update.
+void timer_arm(uint64_t when)
+{
+    armed_at[r_mhartid()] = when;
+#if __riscv_xlen == 64
+    *(volatile uint64_t *)CLINT_MTIMECMP(r_mhartid()) = when;
+#else
+    volatile uint32_t *cmp = (volatile uint32_t *)CLINT_MTIMECMP(r_mhartid());
+    cmp[1] = 0xffffffff;
+    cmp[0] = (uint32_t)when;
+    cmp[1] = (uint32_t)(when >> 32);
+#endif
+}
+
+void timer_disarm(void)
+{
+    armed_at[r_mhartid()] = 0;
+#if __riscv_xlen == 64
+    *(volatile uint64_t *)CLINT_MTIMECMP(r_mhartid()) = 0xffffffffffffffffULL;
+#else
+    volatile uint32_t *cmp = (volatile uint32_t *)CLINT_MTIMECMP(r_mhartid());
+    cmp[1] = 0xffffffff;
+    cmp[0] = 0xffffffff;
+#endif
+}
+
+// mtime ticks since the armed compare value was reached
+uint32_t timer_lateness(void)
+{
+    return (uint32_t)(read_mtime() - armed_at[r_mhartid()]);
+}
+
+
+/*
+    PERIODIC CALLBACKS
+    housekeeping that must happen on an idle system too, e.g. the
+    buffer cache flushing old dirty blocks. the callbacks run in the
+    timer interrupt, so they must not sleep: they only wake the
+    process doing the actual work.
+*/
+#define NPERIODIC 4
+
+static struct {
+    void (*fn)(void);
+    uint32_t period;           // mtime ticks
+    uint64_t next;
+} periodic[NPERIODIC];
+
+// call fn every period_us from now on, 0 if the table is full
+int timer_periodic(void (*fn)(void), uint32_t period_us)
+{
+    reg intr = intr_off();
+    for (int i = 0; i < NPERIODIC; i++) {
+        if (!periodic[i].fn) {
+            periodic[i].fn = fn;
+            periodic[i].period = period_us * (TIMER_FREQ / 1000000);
+            periodic[i].next = read_mtime() + periodic[i].period;
+            uint64_t armed = armed_at[r_mhartid()];
+            if (armed == 0 || periodic[i].next < armed) {
+                timer_arm(periodic[i].next);
+            }
+            intr_restore(intr);
+            return 1;
+        }
+    }
+    intr_restore(intr);
+    return 0;
+}
+
+// earliest periodic deadline, 0 if there is none
+uint64_t timer_periodic_next(void)
+{
+    uint64_t next = 0;
+    for (int i = 0; i < NPERIODIC; i++) {
+        if (periodic[i].fn && (next == 0 || periodic[i].next < next)) {
+            next = periodic[i].next;
+        }
+    }
+    return next;
+}
+
+// timer interrupt: call every callback that is due, arm for the next
+void timer_periodic_run(void)
+{
+    uint64_t now = read_mtime();
+    for (int i = 0; i < NPERIODIC; i++) {
+        if (periodic[i].fn && periodic[i].next <= now) {
+            periodic[i].fn();
+            while (periodic[i].next <= now) {
+                periodic[i].next += periodic[i].period;
+            }
+        }
+    }
+    uint64_t next = timer_periodic_next();
+    if (next) {
+        timer_arm(next);
+    } else {
+        timer_disarm();
+    }
+}
@@ -0,0 +1,45 @@
+#include "kernel_func.h"
+
+extern void trap_vector(void);
+
+/*
+    TRAPS
+    all traps land in trap_vector (trap_vector.S), which saves the
+    caller-saved registers on the current stack and calls here.
+    external interrupts are handed to the PLIC driver (plic.c),
+    which runs the top half registered for the source. timer
+    interrupts run the periodic callbacks (timer.c).
+*/
+
+void trap_handler(reg mcause, reg mepc, reg mtval, reg entry_cycle)
+{
+    if (mcause & MCAUSE_INTR_BIT) {
+        switch (mcause & ~MCAUSE_INTR_BIT) {
+        case IRQ_M_EXT:
+            plic_dispatch(entry_cycle);
+            break;
+        case IRQ_M_TIMER:
+            lat_record(LAT_TIMER_LATE, timer_lateness() * (1000000000 / TIMER_FREQ));
+            lat_record(LAT_IRQ_TIMER, r_cycle() - (uint32_t)entry_cycle);
+            timer_periodic_run();
+            edf_timer_interrupt();   // re-arms the timer for both
+            break;
+        default:
+            mini_printf("unexpected interrupt %d\n", mcause & ~MCAUSE_INTR_BIT);
+            break;
+        }
+        return;
+    }
+
+    // synchronous exception: the kernel has no way to recover
+    mini_printf("EXCEPTION! mcause=%x mepc=%x mtval=%x\n", mcause, mepc, mtval);
+    while (1);
+}
+
+// processes turn mstatus.MIE on when they start, see process_entry()
+void trap_init(void)
+{
+    w_mtvec((reg)trap_vector);
+    timer_disarm();   // mtimecmp is 0 after reset, which would fire at once
+    s_mie(MIE_MEIE | MIE_MTIE);
+}
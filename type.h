@@ -8,8 +8,14 @@ typedef unsigned short uint16_t;
 typedef unsigned long long uint64_t;
 typedef unsigned char uint8_t;
 
+// pointer- and register-sized integers follow the target (make ARCH=)
+#if __riscv_xlen == 64
+typedef uint64_t ptr;
+typedef uint64_t reg;
+#else
 typedef uint32_t ptr;
 typedef uint32_t reg;
+#endif
 
 typedef struct command
 {
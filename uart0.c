@@ -1,6 +1,6 @@
-#include "type.h"
-#include "hardware_conf.h"
+#include "kernel_func.h"
 #include <stdarg.h>
+#include <stddef.h>
 
 /*
  * The UART control registers are memory-mapped at address UART0. 
@@ -32,16 +32,24 @@
 	* OP2 = High  RTS = High DTR = High
 	* RXRDY = High TXRDY = Low INT = Low
  */
+#define IER_RX_ENABLE (1 << 0) // interrupt when a byte arrives.
 #define LSR_RX_READY (1 << 0) // receive data ready.
 #define LSR_TX_IDLE  (1 << 5) // keep sending reg leisure.
 
 #define uart_read_reg(reg) (*(UART_REG(reg))) // macro read regs.
 #define uart_write_reg(reg, v) (*(UART_REG(reg)) = (v)) // macro write regs.
 
+// received bytes, filled by the RX interrupt (uart0_intr)
+#define RX_BUF_SIZE 64
+static char rx_buf[RX_BUF_SIZE];
+static volatile uint32_t rx_head, rx_tail;   // free-running, mod RX_BUF_SIZE
+static WaitQueue rx_wait;                    // readers until a byte arrives
+static int rx_irq;                           // uart0_rx_init() done
+
 void uart0_init()
 {
-	/* disable interrupts. */
-	uart_write_reg(IER, 0x00);
+	/* interrupts off, except RX once uart0_rx_init() enabled it. */
+	uart_write_reg(IER, rx_irq ? IER_RX_ENABLE : 0x00);
 	uint8_t lcr = uart_read_reg(LCR);
 	uart_write_reg(LCR, lcr | (1 << 7));
 	uart_write_reg(DLL, 0x03);
@@ -50,10 +58,10 @@ void uart0_init()
 	uart_write_reg(LCR, lcr | (3 << 0));
 }
 
-int uart0_put_char(char ch)
+void uart0_put_char(char ch)
 {
 	while ((uart_read_reg(LSR) & LSR_TX_IDLE) == 0);
-	return uart_write_reg(THR, ch);
+	uart_write_reg(THR, ch);
 }
 
 void uart0_put_string(char *s)
@@ -63,20 +71,106 @@ void uart0_put_string(char *s)
 	}
 }
 
-// SPINNING GET
+// top half: move every byte the UART holds into rx_buf. RX is level
+// triggered, so RHR must be emptied here or the irq fires again.
+static void uart0_intr(int irq, void* arg)
+{
+    while (uart_read_reg(LSR) & LSR_RX_READY) {
+        char c = uart_read_reg(RHR);
+        if (rx_tail - rx_head < RX_BUF_SIZE) {
+            rx_buf[rx_tail++ % RX_BUF_SIZE] = c;
+        }
+    }
+    wait_queue_wake_all(&rx_wait);
+}
+
+// switch RX from polling to the interrupt, after plic_init()
+void uart0_rx_init(void)
+{
+    wait_queue_init(&rx_wait);
+    if (request_irq(UART0_IRQ, 1, uart0_intr, NULL, "uart0") < 0) {
+        log_err(LOG_UART, "uart0: irq %d busy, rx stays polled\n", UART0_IRQ);
+        return;
+    }
+    rx_irq = 1;
+    uart_write_reg(IER, IER_RX_ENABLE);
+    log_debug(LOG_UART, "uart0: rx on irq %d\n", UART0_IRQ);
+}
+
+// sleep until a byte arrives. before uart0_rx_init(), or outside a
+// process, poll and let the other ready processes run meanwhile.
 char uart0_get_char(void)
 {
-    while((uart_read_reg(LSR) & LSR_RX_READY) == 0);
-    return uart_read_reg(RHR);
+    if (!rx_irq || !current_process()) {
+        while (rx_head == rx_tail && (uart_read_reg(LSR) & LSR_RX_READY) == 0) {
+            process_give_up();
+        }
+        if (rx_head == rx_tail) {
+            return uart_read_reg(RHR);
+        }
+    }
+
+    reg intr = intr_off();
+    while (rx_head == rx_tail) {
+        wait_queue_sleep(&rx_wait);
+    }
+    char c = rx_buf[rx_head++ % RX_BUF_SIZE];
+    intr_restore(intr);
+    return c;
 }
 
 
-static void uart0_put_number(uint32_t num, int base) {
+// write len bytes to the UART
+void uart0_write(const char *s, uint32_t len)
+{
+    while (len--) {
+        uart0_put_char(*s++);
+    }
+}
+
+// where mini_printf output goes: the UART unless redirected, e.g.
+// to the virtio console (virtio_console.c) or the kernel log (log.c).
+// every process has its own (scheduler.c), so a redirected process
+// that sleeps does not take the output of the others along.
+static printf_sink_t boot_out;          // before the first process runs
+
+static printf_sink_t* printf_sink(void)
+{
+    printf_sink_t* out = process_printf_sink();
+    return out ? out : &boot_out;
+}
+
+// send this process's mini_printf output to out (NULL: the UART),
+// returns the old one
+printf_sink_t printf_redirect(printf_sink_t out)
+{
+    printf_sink_t* sink = printf_sink();
+    printf_sink_t old = *sink;
+    *sink = out;
+    return old;
+}
+
+void printf_write(const char *s, uint32_t len)
+{
+    printf_sink_t out = *printf_sink();
+    if (out) {
+        out(s, len);
+    } else {
+        uart0_write(s, len);
+    }
+}
+
+static void printf_put_char(char ch)
+{
+    printf_write(&ch, 1);
+}
+
+static void uart0_put_number(ptr num, int base) {
     char buffer[32];
     char *ptr = buffer;
     
     if (num == 0) {
-        uart0_put_char('0');
+        printf_put_char('0');
         return;
     }
     
@@ -87,12 +181,12 @@ static void uart0_put_number(uint32_t num, int base) {
     }
     
     while (ptr > buffer) {
-        uart0_put_char(*--ptr);
+        printf_put_char(*--ptr);
     }
 }
 static void uart0_put_string_internal(const char *s) {
     while (*s) {
-        uart0_put_char(*s++);
+        printf_put_char(*s++);
     }
 }
 
@@ -111,13 +205,13 @@ void mini_printf(const char *fmt, ...) {
                 }
                 case 'c': {
                     char c = (char)va_arg(args, int);
-                    uart0_put_char(c);
+                    printf_put_char(c);
                     break;
                 }
                 case 'd': {
                     int num = va_arg(args, int);
                     if (num < 0) {
-                        uart0_put_char('-');
+                        printf_put_char('-');
                         num = -num;
                     }
                     uart0_put_number((uint32_t)num, 10);
@@ -141,17 +235,22 @@ void mini_printf(const char *fmt, ...) {
                     break;
                 }
                 case '%': {
-                    uart0_put_char('%');
+                    printf_put_char('%');
                     break;
                 }
                 default: {
-                    uart0_put_char('%');
-                    uart0_put_char(*fmt);
+                    printf_put_char('%');
+                    printf_put_char(*fmt);
                     break;
                 }
             }
         } else {
-            uart0_put_char(*fmt);
+            // plain text up to the next conversion in one piece
+            const char *run = fmt;
+            while (fmt[1] && fmt[1] != '%') {
+                fmt++;
+            }
+            printf_write(run, fmt - run + 1);
         }
         fmt++;
     }
@@ -184,6 +283,56 @@ int strlen(const char *s)
     return len;
 }
 
+// both copy a register at a time (8 bytes on rv64) once aligned
+#define WORD_MASK (sizeof(reg) - 1)
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    if ((((ptr)d ^ (ptr)s) & WORD_MASK) == 0) {
+        while (n && ((ptr)d & WORD_MASK)) {
+            *d++ = *s++;
+            n--;
+        }
+        for (; n >= sizeof(reg); n -= sizeof(reg)) {
+            *(reg *)d = *(const reg *)s;
+            d += sizeof(reg);
+            s += sizeof(reg);
+        }
+    }
+    while (n--) *d++ = *s++;
+    return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n)
+{
+    const uint8_t *p = a, *q = b;
+    for (; n; n--, p++, q++) {
+        if (*p != *q) return *p - *q;
+    }
+    return 0;
+}
+
+void *memset(void *dst, int c, size_t n)
+{
+    uint8_t *d = dst;
+    reg v = (uint8_t)c;
+    v |= v << 8;
+    v |= v << 16;
+    v |= v << 16 << 16;   // no-op on rv32
+    while (n && ((ptr)d & WORD_MASK)) {
+        *d++ = (uint8_t)c;
+        n--;
+    }
+    for (; n >= sizeof(reg); n -= sizeof(reg)) {
+        *(reg *)d = v;
+        d += sizeof(reg);
+    }
+    while (n--) *d++ = (uint8_t)c;
+    return dst;
+}
+
 void readline(char *buffer, int max_length)
 {
     int i = 0;
@@ -0,0 +1,16 @@
+#include "user.h"
+
+int main(int argc, char* argv[])
+{
+    print("hello from user mode, pid ");
+    print_num(getpid());
+    print("\n");
+    for (int i = 0; i < argc; i++) {
+        print("argv[");
+        print_num(i);
+        print("] = ");
+        print(argv[i]);
+        print("\n");
+    }
+    return 0;
+}
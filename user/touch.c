@@ -0,0 +1,38 @@
+#include "user.h"
+
+/*
+    touch [pages]: a big program that only touches part of itself.
+    the read-only table is mapped in place from the initramfs, the
+    initialized data is copied one page at a time on first write,
+    so exec reports page faults for what is touched, not for the
+    whole 512 KiB file.
+*/
+
+#define PAGE 4096
+#define PAGES 64
+
+static const unsigned char table[PAGES * PAGE] = { 1, 2, 3 };
+static unsigned char data[PAGES * PAGE] = { 1, 2, 3 };
+
+int main(int argc, char* argv[])
+{
+    int pages = argc > 1 ? atoi(argv[1]) : 4;
+    if (pages > PAGES) {
+        pages = PAGES;
+    }
+
+    unsigned long sum = 0;
+    for (int i = 0; i < pages; i++) {
+        sum += table[i * PAGE];
+        data[i * PAGE] += 1;
+        sum += data[i * PAGE];
+    }
+    print("touched ");
+    print_num(pages);
+    print(" of ");
+    print_num(PAGES);
+    print(" pages of each, sum ");
+    print_num(sum);
+    print("\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "user.h"
+
+static long syscall(long num, long a0, long a1, long a2)
+{
+    register long r_a7 asm("a7") = num;
+    register long r_a0 asm("a0") = a0;
+    register long r_a1 asm("a1") = a1;
+    register long r_a2 asm("a2") = a2;
+    asm volatile("ecall"
+                 : "+r"(r_a0)
+                 : "r"(r_a1), "r"(r_a2), "r"(r_a7)
+                 : "memory");
+    return r_a0;
+}
+
+long write(int fd, const void* buf, unsigned long len)
+{
+    return syscall(SYS_write, fd, (long)buf, len);
+}
+
+void exit(int code)
+{
+    syscall(SYS_exit, code, 0, 0);
+    while (1);
+}
+
+void yield(void)
+{
+    syscall(SYS_yield, 0, 0, 0);
+}
+
+int getpid(void)
+{
+    return syscall(SYS_getpid, 0, 0, 0);
+}
+
+int strlen(const char* s)
+{
+    int n = 0;
+    while (s[n]) {
+        n++;
+    }
+    return n;
+}
+
+int atoi(const char* s)
+{
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s++ - '0');
+    }
+    return n;
+}
+
+void print(const char* s)
+{
+    write(1, s, strlen(s));
+}
+
+void print_num(unsigned long n)
+{
+    char buf[24];
+    int i = sizeof(buf);
+    buf[--i] = '\0';
+    do {
+        buf[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    print(&buf[i]);
+}
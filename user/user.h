@@ -0,0 +1,23 @@
+#ifndef __USER_H__
+#define __USER_H__
+#include "../syscall.h"
+
+/*
+    what user programs get instead of a libc (ulib.c).
+*/
+
+#define NULL ((void*)0)
+
+// system calls
+long write(int fd, const void* buf, unsigned long len);
+void exit(int code);
+void yield(void);
+int getpid(void);
+
+// helpers
+int strlen(const char* s);
+int atoi(const char* s);
+void print(const char* s);
+void print_num(unsigned long n);
+
+#endif
@@ -0,0 +1,186 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+#include "virtio.h"
+
+/*
+    VIRTIO-MMIO TRANSPORT
+    the device independent half of the virtio drivers: probing the
+    mmio slots, feature negotiation and split virtqueue bookkeeping.
+*/
+
+// find the first transport with a device of the given type.
+// returns its mmio base (0 if none) and its PLIC source in *irq.
+ptr virtio_probe(uint32_t device_id, int* irq)
+{
+    for (int i = 0; i < VIRTIO_SLOTS; i++) {
+        ptr base = VIRTIO0 + i * VIRTIO_STRIDE;
+        if (virtio_read(base, VIRTIO_MMIO_MAGIC_VALUE) != VIRTIO_MAGIC) {
+            continue;
+        }
+        if (virtio_read(base, VIRTIO_MMIO_DEVICE_ID) == device_id) {
+            if (irq) *irq = VIRTIO0_IRQ + i;
+            return base;
+        }
+    }
+    return 0;
+}
+
+// reset the device and negotiate the low 32 feature bits.
+// accepted gets the subset of wanted that the device offers.
+int virtio_setup(ptr base, uint32_t wanted, uint32_t* accepted)
+{
+    uint32_t version = virtio_read(base, VIRTIO_MMIO_VERSION);
+    uint32_t status = 0;
+
+    virtio_write(base, VIRTIO_MMIO_STATUS, status);
+    status |= VIRTIO_STATUS_ACKNOWLEDGE;
+    virtio_write(base, VIRTIO_MMIO_STATUS, status);
+    status |= VIRTIO_STATUS_DRIVER;
+    virtio_write(base, VIRTIO_MMIO_STATUS, status);
+
+    virtio_write(base, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 0);
+    uint32_t features = virtio_read(base, VIRTIO_MMIO_DEVICE_FEATURES) & wanted;
+    virtio_write(base, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 0);
+    virtio_write(base, VIRTIO_MMIO_DRIVER_FEATURES, features);
+
+    if (version >= 2) {
+        // modern devices refuse drivers that do not accept VERSION_1
+        virtio_write(base, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 1);
+        virtio_write(base, VIRTIO_MMIO_DRIVER_FEATURES, 1 << VIRTIO_F_VERSION_1_HI);
+
+        status |= VIRTIO_STATUS_FEATURES_OK;
+        virtio_write(base, VIRTIO_MMIO_STATUS, status);
+        if (!(virtio_read(base, VIRTIO_MMIO_STATUS) & VIRTIO_STATUS_FEATURES_OK)) {
+            virtio_write(base, VIRTIO_MMIO_STATUS, VIRTIO_STATUS_FAILED);
+            return -1;
+        }
+    } else {
+        virtio_write(base, VIRTIO_MMIO_GUEST_PAGE_SIZE, PAGE_SIZE);
+    }
+
+    if (accepted) *accepted = features;
+    return 0;
+}
+
+// the queues are set up, let the device go
+void virtio_driver_ok(ptr base)
+{
+    uint32_t status = virtio_read(base, VIRTIO_MMIO_STATUS);
+    virtio_write(base, VIRTIO_MMIO_STATUS, status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+/*
+    the queue lives in two zeroed pages laid out the legacy way:
+    page 0: descriptor table, then the avail ring
+    page 1: used ring (legacy devices want it on the next 4 KiB boundary)
+*/
+int virtq_init(Virtq* vq, ptr base, int index)
+{
+    virtio_write(base, VIRTIO_MMIO_QUEUE_SEL, index);
+    uint32_t max = virtio_read(base, VIRTIO_MMIO_QUEUE_NUM_MAX);
+    if (max < VIRTQ_SIZE) {
+        mini_printf("virtio: queue %d too short (%d)\n", index, max);
+        return -1;
+    }
+
+    uint8_t* mem = page_alloc(2);
+    if (!mem) {
+        return -1;
+    }
+    memset(mem, 0, 2 * PAGE_SIZE);
+
+    vq->base = base;
+    vq->index = index;
+    vq->desc = (struct virtq_desc*)mem;
+    vq->avail = (struct virtq_avail*)(mem + VIRTQ_SIZE * sizeof(struct virtq_desc));
+    vq->used = (struct virtq_used*)(mem + PAGE_SIZE);
+    vq->last_used = 0;
+
+    // all descriptors free, chained through .next
+    for (int i = 0; i < VIRTQ_SIZE; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    vq->free_head = 0;
+    vq->num_free = VIRTQ_SIZE;
+
+    virtio_write(base, VIRTIO_MMIO_QUEUE_NUM, VIRTQ_SIZE);
+    if (virtio_read(base, VIRTIO_MMIO_VERSION) >= 2) {
+        virtio_write(base, VIRTIO_MMIO_QUEUE_DESC_LOW, (uint32_t)(ptr)vq->desc);
+        virtio_write(base, VIRTIO_MMIO_QUEUE_DESC_HIGH, (uint32_t)((uint64_t)(ptr)vq->desc >> 32));
+        virtio_write(base, VIRTIO_MMIO_QUEUE_AVAIL_LOW, (uint32_t)(ptr)vq->avail);
+        virtio_write(base, VIRTIO_MMIO_QUEUE_AVAIL_HIGH, (uint32_t)((uint64_t)(ptr)vq->avail >> 32));
+        virtio_write(base, VIRTIO_MMIO_QUEUE_USED_LOW, (uint32_t)(ptr)vq->used);
+        virtio_write(base, VIRTIO_MMIO_QUEUE_USED_HIGH, (uint32_t)((uint64_t)(ptr)vq->used >> 32));
+        virtio_write(base, VIRTIO_MMIO_QUEUE_READY, 1);
+    } else {
+        virtio_write(base, VIRTIO_MMIO_QUEUE_ALIGN, PAGE_SIZE);
+        virtio_write(base, VIRTIO_MMIO_QUEUE_PFN, (ptr)mem / PAGE_SIZE);
+    }
+    return 0;
+}
+
+// take one descriptor off the free list, -1 if the ring is full
+int virtq_alloc_desc(Virtq* vq)
+{
+    if (vq->num_free == 0) {
+        return -1;
+    }
+    int i = vq->free_head;
+    vq->free_head = vq->desc[i].next;
+    vq->num_free--;
+    vq->desc[i].flags = 0;
+    return i;
+}
+
+// give a whole chain (as returned by the used ring) back
+void virtq_free_chain(Virtq* vq, int head)
+{
+    int i = head;
+    while (1) {
+        int flags = vq->desc[i].flags;
+        int next = vq->desc[i].next;
+        vq->desc[i].addr = 0;
+        vq->desc[i].len = 0;
+        vq->desc[i].flags = 0;
+        vq->desc[i].next = vq->free_head;
+        vq->free_head = i;
+        vq->num_free++;
+        if (!(flags & VIRTQ_DESC_F_NEXT)) {
+            break;
+        }
+        i = next;
+    }
+}
+
+// publish a chain to the device, it sees it after the next kick
+void virtq_push(Virtq* vq, int head)
+{
+    vq->avail->ring[vq->avail->idx % VIRTQ_SIZE] = head;
+    __sync_synchronize();         // ring entry before the index
+    vq->avail->idx++;
+}
+
+void virtq_kick(Virtq* vq)
+{
+    __sync_synchronize();
+    virtio_write(vq->base, VIRTIO_MMIO_QUEUE_NOTIFY, vq->index);
+}
+
+// next completed chain head, or -1 when the used ring is drained
+int virtq_pop_used(Virtq* vq, uint32_t* len)
+{
+    __sync_synchronize();
+    if (vq->last_used == *(volatile uint16_t *)&vq->used->idx) {
+        return -1;
+    }
+    struct virtq_used_elem* e = &vq->used->ring[vq->last_used % VIRTQ_SIZE];
+    vq->last_used++;
+    if (len) *len = e->len;
+    return e->id;
+}
+
+void virtio_ack_interrupt(ptr base)
+{
+    uint32_t status = virtio_read(base, VIRTIO_MMIO_INTERRUPT_STATUS);
+    virtio_write(base, VIRTIO_MMIO_INTERRUPT_ACK, status & 0x3);
+}
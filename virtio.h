@@ -0,0 +1,118 @@
+#ifndef __VIRTIO_H__
+#define __VIRTIO_H__
+#include "type.h"
+
+/*
+    virtio over MMIO, see "Virtual I/O Device (VIRTIO) Version 1.1",
+    section 4.2. QEMU virt exposes legacy (version 1) transports by
+    default and modern ones (version 2) with
+    -global virtio-mmio.force-legacy=false, both are handled.
+*/
+
+// mmio register offsets
+#define VIRTIO_MMIO_MAGIC_VALUE         0x000   // 0x74726976 ("virt")
+#define VIRTIO_MMIO_VERSION             0x004   // 1 = legacy, 2 = modern
+#define VIRTIO_MMIO_DEVICE_ID           0x008   // 0 = empty slot
+#define VIRTIO_MMIO_VENDOR_ID           0x00c
+#define VIRTIO_MMIO_DEVICE_FEATURES     0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014
+#define VIRTIO_MMIO_DRIVER_FEATURES     0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024
+#define VIRTIO_MMIO_GUEST_PAGE_SIZE     0x028   // legacy only
+#define VIRTIO_MMIO_QUEUE_SEL           0x030
+#define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034
+#define VIRTIO_MMIO_QUEUE_NUM           0x038
+#define VIRTIO_MMIO_QUEUE_ALIGN         0x03c   // legacy only
+#define VIRTIO_MMIO_QUEUE_PFN           0x040   // legacy only
+#define VIRTIO_MMIO_QUEUE_READY         0x044   // modern only
+#define VIRTIO_MMIO_QUEUE_NOTIFY        0x050
+#define VIRTIO_MMIO_INTERRUPT_STATUS    0x060
+#define VIRTIO_MMIO_INTERRUPT_ACK       0x064
+#define VIRTIO_MMIO_STATUS              0x070
+#define VIRTIO_MMIO_QUEUE_DESC_LOW      0x080   // modern only
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH     0x084
+#define VIRTIO_MMIO_QUEUE_AVAIL_LOW     0x090
+#define VIRTIO_MMIO_QUEUE_AVAIL_HIGH    0x094
+#define VIRTIO_MMIO_QUEUE_USED_LOW      0x0a0
+#define VIRTIO_MMIO_QUEUE_USED_HIGH     0x0a4
+#define VIRTIO_MMIO_CONFIG              0x100   // device specific
+
+#define VIRTIO_MAGIC 0x74726976
+
+// device ids
+#define VIRTIO_ID_BLOCK   2
+#define VIRTIO_ID_CONSOLE 3
+
+// status register bits
+#define VIRTIO_STATUS_ACKNOWLEDGE 1
+#define VIRTIO_STATUS_DRIVER      2
+#define VIRTIO_STATUS_DRIVER_OK   4
+#define VIRTIO_STATUS_FEATURES_OK 8
+#define VIRTIO_STATUS_FAILED      128
+
+// transport feature bits (low word)
+#define VIRTIO_RING_F_INDIRECT_DESC 28
+#define VIRTIO_RING_F_EVENT_IDX     29
+// high word, bit 32: required by modern devices
+#define VIRTIO_F_VERSION_1_HI       0
+
+// virtqueue descriptor flags
+#define VIRTQ_DESC_F_NEXT     1
+#define VIRTQ_DESC_F_WRITE    2   // device writes (vs reads)
+#define VIRTQ_DESC_F_INDIRECT 4   // buffer is a table of descriptors
+
+#define VIRTQ_SIZE 16             // descriptors per queue we set up
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[VIRTQ_SIZE];
+    uint16_t used_event;
+};
+
+struct virtq_used_elem {
+    uint32_t id;                  // head of the completed chain
+    uint32_t len;                 // bytes written by the device
+};
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[VIRTQ_SIZE];
+    uint16_t avail_event;
+};
+
+// driver side state of one virtqueue
+typedef struct Virtq {
+    ptr base;                     // mmio base of the transport
+    int index;                    // queue number on the device
+    struct virtq_desc* desc;
+    struct virtq_avail* avail;
+    struct virtq_used* used;
+    uint16_t free_head;           // free descriptors chained by .next
+    int num_free;
+    uint16_t last_used;           // used ring entries already handled
+} Virtq;
+
+#define virtio_read(base, off) (*(volatile uint32_t *)((base) + (off)))
+#define virtio_write(base, off, v) (*(volatile uint32_t *)((base) + (off)) = (v))
+
+extern ptr virtio_probe(uint32_t device_id, int* irq);
+extern int virtio_setup(ptr base, uint32_t wanted, uint32_t* accepted);
+extern void virtio_driver_ok(ptr base);
+extern int virtq_init(Virtq* vq, ptr base, int index);
+extern int virtq_alloc_desc(Virtq* vq);
+extern void virtq_free_chain(Virtq* vq, int head);
+extern void virtq_push(Virtq* vq, int head);
+extern void virtq_kick(Virtq* vq);
+extern int virtq_pop_used(Virtq* vq, uint32_t* len);
+extern void virtio_ack_interrupt(ptr base);
+
+#endif
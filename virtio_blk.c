@@ -0,0 +1,365 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+#include "virtio.h"
+
+/*
+    VIRTIO BLOCK DEVICE
+    QEMU: -drive file=disk.img,if=none,format=raw,id=x0
+          -device virtio-blk-device,drive=x0
+
+    up to VIRTQ_SIZE requests are in flight at once. with indirect
+    descriptors every request costs one ring slot, however many
+    segments it scatters to. completion is signalled by the PLIC:
+    the top half only acks the device, the bottom half (irq worker)
+    reaps the used ring and wakes exactly the processes waiting on
+    the finished requests. without a process to put to sleep (at
+    boot) the driver polls the used ring instead.
+*/
+
+#define VIRTIO_BLK_F_RO 5           // device is read-only
+
+#define VIRTIO_BLK_T_IN  0          // read
+#define VIRTIO_BLK_T_OUT 1          // write
+
+#define VIRTIO_BLK_S_OK 0
+
+struct virtio_blk_outhdr {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+};
+
+// per ring slot, indexed by the head descriptor of the request
+struct blk_slot {
+    struct virtq_desc table[BLK_MAX_SEGS + 2];  // indirect table
+    struct virtio_blk_outhdr hdr;
+    BlkRequest* req;
+    volatile uint8_t status;
+} __attribute__((aligned(16)));
+
+static struct {
+    ptr base;
+    int irq;
+    int indirect;                   // VIRTIO_RING_F_INDIRECT_DESC accepted
+    int read_only;
+    uint64_t capacity;              // in sectors
+    Virtq vq;
+    WaitQueue slot_wait;            // submitters waiting for ring space
+    int inflight;
+    int max_inflight;
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t interrupts;
+    Work work;                      // bottom half
+} blk;
+
+static struct blk_slot slots[VIRTQ_SIZE];
+
+static void virtio_blk_intr(int irq, void* arg);
+static void blk_bottom_half(void* arg);
+
+int virtio_blk_init(void)
+{
+    uint32_t features;
+
+    blk.base = virtio_probe(VIRTIO_ID_BLOCK, &blk.irq);
+    if (!blk.base) {
+        mini_printf("virtio-blk: no disk\n");
+        return 0;
+    }
+
+    uint32_t wanted = (1 << VIRTIO_RING_F_INDIRECT_DESC) | (1 << VIRTIO_BLK_F_RO);
+    if (virtio_setup(blk.base, wanted, &features) < 0 ||
+        virtq_init(&blk.vq, blk.base, 0) < 0) {
+        mini_printf("virtio-blk: setup failed\n");
+        blk.base = 0;
+        return 0;
+    }
+    blk.indirect = (features >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
+    blk.read_only = (features >> VIRTIO_BLK_F_RO) & 1;
+
+    volatile uint32_t* config = (volatile uint32_t*)(blk.base + VIRTIO_MMIO_CONFIG);
+    blk.capacity = ((uint64_t)config[1] << 32) | config[0];
+
+    wait_queue_init(&blk.slot_wait);
+    work_init(&blk.work, blk_bottom_half, NULL, blk.irq);
+    request_irq(blk.irq, 1, virtio_blk_intr, NULL, "virtio-blk");
+    virtio_driver_ok(blk.base);
+
+    mini_printf("virtio-blk: %u KiB at %x irq %d%s%s\n",
+                (uint32_t)(blk.capacity >> 1), blk.base, blk.irq,
+                blk.indirect ? " indirect" : "",
+                blk.read_only ? " read-only" : "");
+    return 1;
+}
+
+uint64_t virtio_blk_capacity(void)
+{
+    return blk.base ? blk.capacity : 0;
+}
+
+// finish every request the device has handed back.
+// runs in the bottom half, or polled, always with interrupts off.
+static void blk_complete_used(void)
+{
+    int head;
+    while ((head = virtq_pop_used(&blk.vq, NULL)) >= 0) {
+        struct blk_slot* slot = &slots[head];
+        BlkRequest* req = slot->req;
+
+        slot->req = NULL;
+        virtq_free_chain(&blk.vq, head);
+        blk.inflight--;
+        blk.completed++;
+
+        req->status = slot->status;
+        req->done = 1;
+        wait_queue_wake_all(&req->waiters);
+        wait_queue_wake_one(&blk.slot_wait);
+        // last: the callback may recycle req
+        if (req->complete) {
+            req->complete(req);
+        }
+    }
+}
+
+static void blk_poll(void)
+{
+    virtio_ack_interrupt(blk.base);
+    blk_complete_used();
+}
+
+// top half
+static void virtio_blk_intr(int irq, void* arg)
+{
+    blk.interrupts++;
+    virtio_ack_interrupt(blk.base);
+    work_schedule(&blk.work);
+}
+
+static void blk_bottom_half(void* arg)
+{
+    reg intr = intr_off();
+    blk_complete_used();
+    intr_restore(intr);
+}
+
+// fill desc as one buffer of the request chain
+static void blk_desc(struct virtq_desc* d, void* addr, uint32_t len, int device_writes)
+{
+    d->addr = (ptr)addr;
+    d->len = len;
+    d->flags = device_writes ? VIRTQ_DESC_F_WRITE : 0;
+}
+
+// queue req and return at once, use virtio_blk_wait() or req->complete
+// to learn when it is done. req->sector/write/nseg/seg must be set.
+int virtio_blk_submit(BlkRequest* req)
+{
+    if (!blk.base || req->nseg < 1 || req->nseg > BLK_MAX_SEGS) {
+        return -1;
+    }
+    if (req->write && blk.read_only) {
+        return -1;
+    }
+
+    int ndesc = blk.indirect ? 1 : req->nseg + 2;
+    req->done = 0;
+    req->status = 0xff;
+    wait_queue_init(&req->waiters);
+
+    reg intr = intr_off();
+    while (blk.vq.num_free < ndesc) {
+        if (current_process()) {
+            wait_queue_sleep(&blk.slot_wait);
+        } else {
+            blk_poll();
+        }
+    }
+
+    int head = virtq_alloc_desc(&blk.vq);
+    struct blk_slot* slot = &slots[head];
+    slot->req = req;
+    slot->status = 0xff;
+    slot->hdr.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    slot->hdr.reserved = 0;
+    slot->hdr.sector = req->sector;
+
+    // header, data segments, status byte
+    int n = req->nseg + 2;
+    if (blk.indirect) {
+        struct virtq_desc* t = slot->table;
+        blk_desc(&t[0], &slot->hdr, sizeof(slot->hdr), 0);
+        for (int i = 0; i < req->nseg; i++) {
+            blk_desc(&t[i + 1], req->seg[i].buf, req->seg[i].len, !req->write);
+        }
+        blk_desc(&t[n - 1], (void*)&slot->status, 1, 1);
+        for (int i = 0; i < n - 1; i++) {
+            t[i].flags |= VIRTQ_DESC_F_NEXT;
+            t[i].next = i + 1;
+        }
+
+        blk.vq.desc[head].addr = (ptr)t;
+        blk.vq.desc[head].len = n * sizeof(struct virtq_desc);
+        blk.vq.desc[head].flags = VIRTQ_DESC_F_INDIRECT;
+    } else {
+        int d = head;
+        for (int i = 0; i < n; i++) {
+            struct virtq_desc* desc = &blk.vq.desc[d];
+            if (i == 0) {
+                blk_desc(desc, &slot->hdr, sizeof(slot->hdr), 0);
+            } else if (i == n - 1) {
+                blk_desc(desc, (void*)&slot->status, 1, 1);
+                break;
+            } else {
+                blk_desc(desc, req->seg[i - 1].buf, req->seg[i - 1].len, !req->write);
+            }
+            desc->next = virtq_alloc_desc(&blk.vq);
+            desc->flags |= VIRTQ_DESC_F_NEXT;
+            d = desc->next;
+        }
+    }
+
+    virtq_push(&blk.vq, head);
+    virtq_kick(&blk.vq);
+
+    blk.submitted++;
+    if (++blk.inflight > blk.max_inflight) {
+        blk.max_inflight = blk.inflight;
+    }
+    intr_restore(intr);
+    return 0;
+}
+
+// sleep until req is done, returns 0 on success
+int virtio_blk_wait(BlkRequest* req)
+{
+    reg intr = intr_off();
+    while (!req->done) {
+        if (current_process()) {
+            wait_queue_sleep(&req->waiters);
+        } else {
+            blk_poll();   // no process to put to sleep (boot time)
+        }
+    }
+    intr_restore(intr);
+    return req->status == VIRTIO_BLK_S_OK ? 0 : -1;
+}
+
+// synchronous read/write of len bytes (a multiple of BLK_SECTOR_SIZE)
+int virtio_blk_rw(uint64_t sector, void* buf, uint32_t len, int write)
+{
+    BlkRequest req;
+    req.sector = sector;
+    req.write = write;
+    req.nseg = 1;
+    req.seg[0].buf = buf;
+    req.seg[0].len = len;
+    req.complete = NULL;
+    req.priv = NULL;
+
+    if (virtio_blk_submit(&req) < 0) {
+        return -1;
+    }
+    return virtio_blk_wait(&req);
+}
+
+
+/*
+    THROUGHPUT BENCHMARK
+    BENCH_DEPTH requests in flight, each BENCH_SEGS pages scattered
+    over separately allocated pages.
+*/
+#define BENCH_DEPTH 8
+#define BENCH_SEGS 4
+#define BENCH_SECTORS (BENCH_SEGS * PAGE_SIZE / BLK_SECTOR_SIZE)
+
+static BlkRequest bench_reqs[BENCH_DEPTH];
+
+static void blk_bench_run(const char* name, int nreq, int write, int random)
+{
+    // 64-bit division needs libgcc, and no bench goes past 2 TiB anyway
+    uint32_t sectors = blk.capacity > 0xffffffff ? 0xffffffff : (uint32_t)blk.capacity;
+    uint32_t units = sectors / BENCH_SECTORS;
+    uint32_t seed = 12345;
+
+    uint64_t start = read_mtime();
+    for (int i = 0; i < nreq; i++) {
+        BlkRequest* req = &bench_reqs[i % BENCH_DEPTH];
+        if (i >= BENCH_DEPTH) {
+            virtio_blk_wait(req);
+        }
+
+        uint32_t unit = i % units;
+        if (random) {
+            seed = seed * 1103515245 + 12345;
+            unit = (seed >> 8) % units;
+        }
+        req->sector = (uint64_t)unit * BENCH_SECTORS;
+        req->write = write;
+        if (virtio_blk_submit(req) < 0) {
+            mini_printf("blkbench: submit failed\n");
+            nreq = i;
+            break;
+        }
+    }
+    for (int i = 0; i < BENCH_DEPTH && i < nreq; i++) {
+        virtio_blk_wait(&bench_reqs[i]);
+    }
+    uint32_t us = ticks_to_us((uint32_t)(read_mtime() - start));
+
+    uint32_t kib = nreq * BENCH_SEGS * PAGE_SIZE / 1024;
+    mini_printf("  %s: %d x %d KiB in %u us", name, nreq, BENCH_SEGS * PAGE_SIZE / 1024, us);
+    if (us >= 1000) {
+        mini_printf(", %u KiB/s, %u IOPS", kib * 1000 / (us / 1000), nreq * 1000 / (us / 1000));
+    }
+    mini_printf("\n");
+}
+
+void virtio_blk_bench(int nreq, int do_write)
+{
+    if (!blk.base || blk.capacity < BENCH_SECTORS) {
+        mini_printf("blkbench: no disk\n");
+        return;
+    }
+    if (do_write && blk.read_only) {
+        mini_printf("blkbench: disk is read-only\n");
+        do_write = 0;
+    }
+
+    int ok = 1;
+    for (int r = 0; r < BENCH_DEPTH; r++) {
+        bench_reqs[r].nseg = BENCH_SEGS;
+        bench_reqs[r].complete = NULL;
+        bench_reqs[r].priv = NULL;
+        for (int s = 0; s < BENCH_SEGS; s++) {
+            bench_reqs[r].seg[s].buf = page_alloc(1);
+            bench_reqs[r].seg[s].len = PAGE_SIZE;
+            if (!bench_reqs[r].seg[s].buf) ok = 0;
+        }
+    }
+
+    if (ok) {
+        uint32_t submitted = blk.submitted;
+        uint32_t interrupts = blk.interrupts;
+        blk.max_inflight = 0;
+
+        mini_printf("blkbench: depth %d, %d segments per request\n", BENCH_DEPTH, BENCH_SEGS);
+        blk_bench_run("seq read  ", nreq, 0, 0);
+        blk_bench_run("rand read ", nreq, 0, 1);
+        if (do_write) {
+            blk_bench_run("seq write ", nreq, 1, 0);
+            blk_bench_run("rand write", nreq, 1, 1);
+        }
+        mini_printf("  %u requests, %u interrupts, max %d in flight\n",
+                    blk.submitted - submitted, blk.interrupts - interrupts, blk.max_inflight);
+    } else {
+        mini_printf("blkbench: out of pages\n");
+    }
+
+    for (int r = 0; r < BENCH_DEPTH; r++) {
+        for (int s = 0; s < BENCH_SEGS; s++) {
+            page_free(bench_reqs[r].seg[s].buf);
+        }
+    }
+}
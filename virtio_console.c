@@ -0,0 +1,268 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+#include "virtio.h"
+
+/*
+    VIRTIO CONSOLE
+    QEMU: -device virtio-serial-device
+          -chardev file,id=vcon0,path=console.out
+          -device virtconsole,chardev=vcon0
+
+    a bulk output path next to the UART. the 16550 takes one byte per
+    MMIO write, and each of those traps into QEMU. here output is
+    gathered in VCON_BUF_SIZE buffers and every full buffer goes to
+    the device as a single descriptor with a single notification.
+    VCON_NBUF buffers rotate, so filling the next one overlaps with
+    the device draining the last.
+
+    only output is handled: the UART stays the interactive console,
+    and carries everything at boot. `bulk <command>` sends the output
+    of one shell command here (dmesg, lat, irqstat...).
+*/
+
+#define VCON_TXQ 1                          // port 0 transmitq, without MULTIPORT
+#define VCON_NBUF 8                         // at most VIRTQ_SIZE
+#define VCON_BUF_PAGES 4
+#define VCON_BUF_SIZE (VCON_BUF_PAGES * PAGE_SIZE)
+
+static struct {
+    ptr base;
+    int irq;
+    Virtq vq;
+    char* buf[VCON_NBUF];
+    int free[VCON_NBUF];                    // idle buffers
+    int nfree;
+    int desc_buf[VIRTQ_SIZE];               // head descriptor -> buffer
+    int cur;                                // buffer being filled, -1 if none
+    uint32_t cur_len;
+    WaitQueue wait;                         // writers waiting for a buffer
+    Work work;                              // bottom half
+    uint32_t bytes;
+    uint32_t buffers;
+    uint32_t waits;
+    uint32_t interrupts;
+} vcon;
+
+static void vcon_intr(int irq, void* arg);
+static void vcon_bottom_half(void* arg);
+
+int virtio_console_init(void)
+{
+    vcon.base = virtio_probe(VIRTIO_ID_CONSOLE, &vcon.irq);
+    if (!vcon.base) {
+        return 0;
+    }
+
+    if (virtio_setup(vcon.base, 0, NULL) < 0 ||
+        virtq_init(&vcon.vq, vcon.base, VCON_TXQ) < 0) {
+        mini_printf("virtio-console: setup failed\n");
+        vcon.base = 0;
+        return 0;
+    }
+    for (int i = 0; i < VCON_NBUF; i++) {
+        vcon.buf[i] = page_alloc(VCON_BUF_PAGES);
+        if (!vcon.buf[i]) {
+            mini_printf("virtio-console: out of pages\n");
+            vcon.base = 0;
+            return 0;
+        }
+        vcon.free[vcon.nfree++] = i;
+    }
+    vcon.cur = -1;
+
+    wait_queue_init(&vcon.wait);
+    work_init(&vcon.work, vcon_bottom_half, NULL, vcon.irq);
+    request_irq(vcon.irq, 1, vcon_intr, NULL, "virtio-console");
+    virtio_driver_ok(vcon.base);
+
+    mini_printf("virtio-console: %d x %d KiB buffers at %x irq %d\n",
+                VCON_NBUF, VCON_BUF_SIZE / 1024, vcon.base, vcon.irq);
+    return 1;
+}
+
+int vcon_present(void)
+{
+    return vcon.base != 0;
+}
+
+uint32_t vcon_bytes(void)
+{
+    return vcon.bytes;
+}
+
+// take back the buffers the device is done with, interrupts off
+static void vcon_complete_used(void)
+{
+    int head;
+    while ((head = virtq_pop_used(&vcon.vq, NULL)) >= 0) {
+        vcon.free[vcon.nfree++] = vcon.desc_buf[head];
+        virtq_free_chain(&vcon.vq, head);
+        wait_queue_wake_one(&vcon.wait);
+    }
+}
+
+// top half
+static void vcon_intr(int irq, void* arg)
+{
+    vcon.interrupts++;
+    virtio_ack_interrupt(vcon.base);
+    work_schedule(&vcon.work);
+}
+
+static void vcon_bottom_half(void* arg)
+{
+    reg intr = intr_off();
+    vcon_complete_used();
+    intr_restore(intr);
+}
+
+// hand the buffer being filled to the device, interrupts off
+static void vcon_submit(void)
+{
+    if (vcon.cur < 0 || vcon.cur_len == 0) {
+        return;
+    }
+    // one descriptor per buffer, and VCON_NBUF <= VIRTQ_SIZE
+    int head = virtq_alloc_desc(&vcon.vq);
+    vcon.vq.desc[head].addr = (ptr)vcon.buf[vcon.cur];
+    vcon.vq.desc[head].len = vcon.cur_len;
+    vcon.vq.desc[head].flags = 0;           // device reads
+    vcon.desc_buf[head] = vcon.cur;
+    virtq_push(&vcon.vq, head);
+    virtq_kick(&vcon.vq);
+
+    vcon.bytes += vcon.cur_len;
+    vcon.buffers++;
+    vcon.cur = -1;
+    vcon.cur_len = 0;
+}
+
+// make sure there is a buffer to fill, interrupts off
+static void vcon_get_buffer(void)
+{
+    while (vcon.cur < 0) {
+        if (vcon.nfree > 0) {
+            vcon.cur = vcon.free[--vcon.nfree];
+            vcon.cur_len = 0;
+        } else if (current_process()) {
+            vcon.waits++;
+            wait_queue_sleep(&vcon.wait);
+        } else {
+            virtio_ack_interrupt(vcon.base);   // no process to put to sleep (boot time)
+            vcon_complete_used();
+        }
+    }
+}
+
+// queue len bytes, they go out once a buffer fills up or on vcon_flush().
+// without the device it writes to the UART.
+void vcon_write(const char* s, uint32_t len)
+{
+    if (!vcon.base) {
+        uart0_write(s, len);
+        return;
+    }
+
+    reg intr = intr_off();
+    while (len > 0) {
+        vcon_get_buffer();
+        uint32_t n = VCON_BUF_SIZE - vcon.cur_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(vcon.buf[vcon.cur] + vcon.cur_len, s, n);
+        vcon.cur_len += n;
+        s += n;
+        len -= n;
+        if (vcon.cur_len == VCON_BUF_SIZE) {
+            vcon_submit();
+        }
+    }
+    intr_restore(intr);
+}
+
+// send what is buffered
+void vcon_flush(void)
+{
+    if (!vcon.base) {
+        return;
+    }
+    reg intr = intr_off();
+    vcon_submit();
+    intr_restore(intr);
+}
+
+void vcon_stat(void)
+{
+    if (!vcon.base) {
+        mini_printf("no virtio console\n");
+        return;
+    }
+    mini_printf("virtio-console: %u bytes in %u buffers", vcon.bytes, vcon.buffers);
+    if (vcon.buffers) {
+        mini_printf(", avg %u bytes", vcon.bytes / vcon.buffers);
+    }
+    mini_printf("\n  %u waits for a free buffer, %u interrupts\n", vcon.waits, vcon.interrupts);
+}
+
+
+/*
+    THROUGHPUT BENCHMARK
+    the same trace-like lines through both paths. the UART only gets
+    a small sample, at its speed a megabyte takes minutes.
+*/
+#define BENCH_UART_KIB 2
+
+static uint32_t bench_line(char* line, uint32_t i)
+{
+    // "trace 0000001f: ..." padded to 64 bytes
+    static const char hex[] = "0123456789abcdef";
+    memcpy(line, "trace ", 6);
+    for (int d = 0; d < 8; d++) {
+        line[6 + d] = hex[(i >> (28 - 4 * d)) & 0xf];
+    }
+    memset(line + 14, '.', 63 - 14);
+    line[14] = ':';
+    line[63] = '\n';
+    return 64;
+}
+
+static uint32_t bench_run(void (*out)(const char* s, uint32_t len), uint32_t kib)
+{
+    char line[64];
+    uint32_t lines = kib * 1024 / sizeof(line);
+
+    uint64_t start = read_mtime();
+    for (uint32_t i = 0; i < lines; i++) {
+        out(line, bench_line(line, i));
+    }
+    if (out == vcon_write) {
+        vcon_flush();
+    }
+    return ticks_to_us((uint32_t)(read_mtime() - start));
+}
+
+static void bench_report(const char* name, uint32_t kib, uint32_t us)
+{
+    mini_printf("  %s: %u KiB in %u us", name, kib, us);
+    if (us >= 1000) {
+        mini_printf(", %u KiB/s", kib * 1000 / (us / 1000));
+    }
+    mini_printf("\n");
+}
+
+void vcon_bench(uint32_t kib)
+{
+    if (!vcon.base) {
+        mini_printf("conbench: no virtio console\n");
+        return;
+    }
+    uint32_t buffers = vcon.buffers;
+    uint32_t virtio_us = bench_run(vcon_write, kib);
+    uint32_t uart_us = bench_run(uart0_write, BENCH_UART_KIB);
+
+    mini_printf("conbench:\n");
+    bench_report("virtio-console", kib, virtio_us);
+    bench_report("uart          ", BENCH_UART_KIB, uart_us);
+    mini_printf("  %u buffers, %u waits for a free one\n", vcon.buffers - buffers, vcon.waits);
+}
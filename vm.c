@@ -0,0 +1,105 @@
+#include "kernel_func.h"
+#include "mem_info.h"
+
+/*
+    USER PAGE TABLES
+    the kernel itself runs in M-mode on physical addresses; only
+    user programs (exec.c) run translated, with Sv32 page tables on
+    rv32 and Sv39 on rv64. every table is one page from page_alloc.
+    leaf pages marked PTE_OWNED were allocated for the process and
+    are freed with the table, the others (code mapped in place from
+    the initramfs) are not.
+*/
+
+// let U-mode reach all of memory through the page tables, and read
+// the cycle/time counters. without a PMP entry every U-mode access
+// faults.
+void vm_init(void)
+{
+#if __riscv_xlen == 64
+    w_pmpaddr0(0x3fffffffffffffULL);
+#else
+    w_pmpaddr0(0xffffffff);
+#endif
+    w_pmpcfg0(0xf);          // TOR, R/W/X
+    w_mcounteren(0x7);       // cycle, time, instret
+}
+
+pte_t* uvm_create(void)
+{
+    pte_t* pt = page_alloc(1);
+    if (pt) {
+        memset(pt, 0, PAGE_SIZE);
+    }
+    return pt;
+}
+
+// the leaf entry for va, allocating the tables on the way if asked
+pte_t* uvm_walk(pte_t* pt, ptr va, int alloc)
+{
+    for (int level = PT_LEVELS - 1; level > 0; level--) {
+        pte_t* pte = &pt[PX(level, va)];
+        if (*pte & PTE_V) {
+            pt = (pte_t*)PTE2PA(*pte);
+        } else {
+            if (!alloc || (pt = page_alloc(1)) == NULL) {
+                return NULL;
+            }
+            memset(pt, 0, PAGE_SIZE);
+            *pte = PA2PTE(pt) | PTE_V;
+        }
+    }
+    return &pt[PX(0, va)];
+}
+
+// map the page at va to pa. A and D are set up front, so the
+// hardware never has to update them.
+int uvm_map(pte_t* pt, ptr va, void* pa, int perm)
+{
+    pte_t* pte = uvm_walk(pt, va, 1);
+    if (!pte || (*pte & PTE_V)) {
+        return -1;
+    }
+    *pte = PA2PTE(pa) | perm | PTE_U | PTE_A | PTE_D | PTE_V;
+    return 0;
+}
+
+// physical address of user va, 0 if it is not mapped with `perm`
+void* uvm_translate(pte_t* pt, ptr va, int perm)
+{
+    pte_t* pte = uvm_walk(pt, va, 0);
+    if (!pte || (*pte & (PTE_V | PTE_U | perm)) != (PTE_V | PTE_U | perm)) {
+        return NULL;
+    }
+    return (void*)(PTE2PA(*pte) + (va & (PAGE_SIZE - 1)));
+}
+
+static void uvm_free_level(pte_t* pt, int level)
+{
+    for (int i = 0; i < PTE_PER_PAGE; i++) {
+        pte_t pte = pt[i];
+        if (!(pte & PTE_V)) {
+            continue;
+        }
+        if (level > 0) {
+            uvm_free_level((pte_t*)PTE2PA(pte), level - 1);
+        } else if (pte & PTE_OWNED) {
+            page_free((void*)PTE2PA(pte));
+        }
+    }
+    page_free(pt);
+}
+
+void uvm_free(pte_t* pt)
+{
+    if (pt) {
+        uvm_free_level(pt, PT_LEVELS - 1);
+    }
+}
+
+// make pt the translation for U-mode
+void uvm_switch(pte_t* pt)
+{
+    w_satp(SATP_MODE | ((ptr)pt >> PGSHIFT));
+    sfence_vma();
+}